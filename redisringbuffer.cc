@@ -1,122 +1,734 @@
 #include "redismodule.h"
 #include "ring_buffer.h"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <strings.h>
+#include <string>
+#include <deque>
+#include <map>
 
-class RedisRingBuffer : public std::RingBuffer<RedisModuleString*> {
-public:
-	RedisRingBuffer(RedisModuleCtx* ctx_, const size_t size_) : std::RingBuffer<RedisModuleString * >(size_, sizeof (RedisModuleString*), false), ctx(ctx_) {
-		elements = (RedisModuleString**)RedisModule_Alloc(size * an_element_size);
-		for (size_t i = 0; i < size; i++) {
-			elements[i] = NULL;
+/*
+ * Backs std::RingBuffer storage with the module allocator so it is
+ * accounted in used_memory.
+ */
+struct RedisModuleAllocator {
+	inline void* allocate(const size_t bytes) {
+		return (RedisModule_Alloc(bytes));
+	}
+
+	inline void deallocate(void* p, const size_t) {
+		RedisModule_Free(p);
+	}
+};
+
+enum RedisRingBufferType {
+	RING_BUFFER_STRING = 0,
+	RING_BUFFER_INT64 = 1,
+	RING_BUFFER_DOUBLE = 2
+};
+
+/*
+ * An element taken out of a ring, to be replied as a (key, value) pair
+ * possibly after the ring itself has changed.
+ */
+struct RedisRingBufferValue {
+	std::string key;
+	RedisRingBufferType type;
+	std::string text;
+	long long integer;
+	double real;
+
+	inline void set(const char* data, const size_t length) {
+		type = RING_BUFFER_STRING;
+		text.assign(data, length);
+	}
+
+	inline void set(const long long value) {
+		type = RING_BUFFER_INT64;
+		integer = value;
+	}
+
+	inline void set(const double value) {
+		type = RING_BUFFER_DOUBLE;
+		real = value;
+	}
+
+	inline int reply(RedisModuleCtx* ctx) const {
+		RedisModule_ReplyWithArray(ctx, 2);
+		RedisModule_ReplyWithStringBuffer(ctx, key.data(), key.size());
+		switch (type) {
+		case RING_BUFFER_INT64:
+			return RedisModule_ReplyWithLongLong(ctx, integer);
+		case RING_BUFFER_DOUBLE:
+			return RedisModule_ReplyWithDouble(ctx, real);
+		default:
+			return RedisModule_ReplyWithStringBuffer(ctx, text.data(), text.size());
 		}
 	}
+};
+
+/*
+ * The value of a ring buffer key. Elements are addressed by logical index,
+ * 0 being the front; the commands only go through this interface, so string
+ * and typed numeric rings behave alike.
+ */
+class RedisRingBuffer {
+public:
+	RedisRingBuffer() : quantiles(NULL) {
+	}
 
 	virtual ~RedisRingBuffer() {
-		for (size_t i = 0; i < size; i++) {
-			if (elements[i]) {
-				RedisModule_FreeString(ctx, elements[i]);
-				elements[i] = NULL;
-			}
+		delete quantiles;
+	}
+
+	virtual RedisRingBufferType type() const = 0;
+	virtual size_t buffer_size() const = 0;
+	virtual size_t length() const = 0;
+	virtual bool is_full() const = 0;
+	virtual bool is_empty() const = 0;
+	virtual void clear() = 0;
+
+	/*
+	 * Appends count values, or none and returns false if one of them is not
+	 * a valid element for this ring.
+	 */
+	virtual bool write(RedisModuleString** values, const int count) = 0;
+
+	virtual int reply(RedisModuleCtx* ctx, const size_t i) const = 0;
+
+	/*
+	 * Removes the front element and replies with it.
+	 */
+	virtual int reply_read(RedisModuleCtx* ctx) = 0;
+
+	/*
+	 * Removes the front element into value.
+	 */
+	virtual void read_value(RedisRingBufferValue& value) = 0;
+
+	virtual size_t memory_usage() const = 0;
+
+	/*
+	 * Writes the type-specific part of the RDB value.
+	 */
+	virtual void save(RedisModuleIO* rdb) const = 0;
+
+	virtual void rewrite(RedisModuleIO* aof, RedisModuleString* key) const = 0;
+
+	/*
+	 * Quantile of the numeric elements. The sketch is built from the current
+	 * contents on the first query and then kept in step by writes, reads and
+	 * clears; it is not persisted.
+	 */
+	inline double quantile(const double q) {
+		if (!quantiles) {
+			quantiles = new std::RingBufferQuantileSketch(QUANTILE_ACCURACY);
+			fill_sketch();
 		}
+		return (quantiles->quantile(q));
+	}
+
+	inline size_t numeric_length() {
+		quantile(0.0);
+		return ((size_t)quantiles->count());
+	}
+
+protected:
+	static constexpr double QUANTILE_ACCURACY = 0.01;
+
+	std::RingBufferQuantileSketch* quantiles;
+
+	virtual void fill_sketch() = 0;
+};
+
+/*
+ * A slot locates one payload in the key's byte arena.
+ */
+struct RedisRingBufferSlot {
+	size_t offset;
+	size_t length;
+};
+
+/*
+ * String ring. Payloads are kept in one module-owned byte arena per key
+ * instead of one RedisModuleString per slot. Elements leave the ring oldest
+ * first, so the arena is used as a circular byte buffer: records are
+ * appended at arena_end and the live bytes begin at the payload of the front
+ * slot. When a record does not fit, the arena doubles and the live records
+ * are compacted into it in order. Reply strings are created only when an
+ * element is read.
+ */
+class RedisStringRingBuffer : public RedisRingBuffer, public std::RingBuffer<RedisRingBufferSlot> {
+public:
+	typedef RedisRingBufferSlot Slot;
+	typedef std::RingBuffer<Slot> Ring;
+
+	RedisStringRingBuffer(const size_t size_) : Ring(size_, sizeof (Slot), false), arena(NULL), arena_size(0), arena_end(0) {
+		elements = (Slot*)RedisModule_Alloc(size * an_element_size);
+		memset((void*)elements, 0, size * an_element_size);
+	}
+
+	virtual ~RedisStringRingBuffer() {
 		RedisModule_Free(elements);
 		elements = NULL;
+		if (arena) {
+			RedisModule_Free(arena);
+		}
 	}
 
-	inline size_t memory_usage() const {
-		size_t size = sizeof(RedisRingBuffer);
+	/*
+	 * Reads the encver 0/1 body: the cursors and every physical slot, unused
+	 * ones as empty strings.
+	 */
+	static RedisStringRingBuffer* load_slots(RedisModuleIO* rdb) {
+		size_t size = (size_t)RedisModule_LoadUnsigned(rdb);
+		size_t start = (size_t)RedisModule_LoadUnsigned(rdb);
+		size_t end = (size_t)RedisModule_LoadUnsigned(rdb);
+		short int s_msb = (short int)RedisModule_LoadSigned(rdb);
+		short int e_msb = (short int)RedisModule_LoadSigned(rdb);
+		char** payloads = (char**)RedisModule_Alloc(sizeof(char*) * size);
+		size_t* lengths = (size_t*)RedisModule_Alloc(sizeof(size_t) * size);
 		for (size_t i = 0; i < size; i++) {
-			if (elements[i]) {
-				size_t len = 0;
-				RedisModule_StringPtrLen(elements[i], &len);
-				size += len;
+			payloads[i] = RedisModule_LoadStringBuffer(rdb, &lengths[i]);
+		}
+		RedisStringRingBuffer* buffer = new RedisStringRingBuffer(size);
+		buffer->on_load(start, end, s_msb, e_msb, payloads, lengths);
+		for (size_t i = 0; i < size; i++) {
+			RedisModule_Free(payloads[i]);
+		}
+		RedisModule_Free(payloads);
+		RedisModule_Free(lengths);
+		return (buffer);
+	}
+
+	/*
+	 * Reads the body written by save() straight into the arena.
+	 */
+	static RedisStringRingBuffer* load(RedisModuleIO* rdb) {
+		const size_t size = (size_t)RedisModule_LoadUnsigned(rdb);
+		const size_t length = (size_t)RedisModule_LoadUnsigned(rdb);
+		const size_t bytes = (size_t)RedisModule_LoadUnsigned(rdb);
+		if (length > size) {
+			return (NULL);
+		}
+		RedisStringRingBuffer* buffer = new RedisStringRingBuffer(size);
+		if (bytes) {
+			buffer->arena = (char*)RedisModule_Alloc(bytes);
+			buffer->arena_size = bytes;
+		}
+		size_t loaded = 0;
+		while (loaded < length) {
+			size_t blob_length = 0;
+			char* blob = RedisModule_LoadStringBuffer(rdb, &blob_length);
+			size_t p = 0;
+			while ((loaded < length) && (p + sizeof (uint32_t) <= blob_length)) {
+				uint32_t record;
+				memcpy(&record, blob + p, sizeof (record));
+				p += sizeof (record);
+				if ((record > blob_length - p) || (record > bytes - buffer->arena_end)) {
+					break;
+				}
+				Slot& slot = buffer->elements[loaded++];
+				slot.offset = buffer->arena_end;
+				slot.length = record;
+				if (record) {
+					memcpy(buffer->arena + slot.offset, blob + p, record);
+				}
+				buffer->arena_end += record;
+				p += record;
+			}
+			RedisModule_Free(blob);
+			if ((blob_length == 0) || (p != blob_length)) {
+				delete buffer;
+				return (NULL);
 			}
 		}
-		return (size);
+		buffer->restore(length);
+		return (buffer);
+	}
+
+	virtual RedisRingBufferType type() const {
+		return (RING_BUFFER_STRING);
+	}
+
+	virtual size_t buffer_size() const {
+		return (Ring::buffer_size());
+	}
+
+	virtual size_t length() const {
+		return (Ring::length());
+	}
+
+	virtual bool is_full() const {
+		return (Ring::is_full());
+	}
+
+	virtual bool is_empty() const {
+		return (Ring::is_empty());
+	}
+
+	virtual void clear() {
+		Ring::clear();
+		if (arena) {
+			RedisModule_Free(arena);
+		}
+		arena = NULL;
+		arena_size = 0;
+		arena_end = 0;
+		if (quantiles) {
+			quantiles->clear();
+		}
 	}
 
-	inline void write_string(const RedisModuleString* element) {
-		if (elements[b_end]) {
-			RedisModule_FreeString(ctx, elements[b_end]);
+	virtual bool write(RedisModuleString** values, const int count) {
+		for (int i = 0; i < count; i++) {
+			size_t length = 0;
+			const char* payload = RedisModule_StringPtrLen(values[i], &length);
+			write_buffer(payload, length);
+		}
+		return (true);
+	}
+
+	virtual int reply(RedisModuleCtx* ctx, const size_t i) const {
+		return (reply_slot(ctx, (*this)[i]));
+	}
+
+	virtual int reply_read(RedisModuleCtx* ctx) {
+		return (reply_slot(ctx, read()));
+	}
+
+	virtual void read_value(RedisRingBufferValue& value) {
+		const Slot& slot = read();
+		value.set(data(slot), slot.length);
+	}
+
+	virtual size_t memory_usage() const {
+		return (sizeof (RedisStringRingBuffer) + size * an_element_size + arena_size + (quantiles ? quantiles->bytes() : 0));
+	}
+
+	/*
+	 * Saves the live elements only, oldest first, as records of a native
+	 * uint32 length followed by the payload, packed into blobs of about
+	 * BLOB_SIZE bytes.
+	 */
+	virtual void save(RedisModuleIO* rdb) const {
+		size_t bytes = 0;
+		for (size_t i = 0; i < length(); i++) {
+			bytes += (*this)[i].length;
+		}
+		RedisModule_SaveUnsigned(rdb, size);
+		RedisModule_SaveUnsigned(rdb, length());
+		RedisModule_SaveUnsigned(rdb, bytes);
+		std::string blob;
+		for (size_t i = 0; i < length(); i++) {
+			const Slot& slot = (*this)[i];
+			const uint32_t record = (uint32_t)slot.length;
+			if (!blob.empty() && (blob.size() + sizeof (record) + record > BLOB_SIZE)) {
+				RedisModule_SaveStringBuffer(rdb, blob.data(), blob.size());
+				blob.clear();
+			}
+			blob.append((const char*)&record, sizeof (record));
+			blob.append(data(slot), slot.length);
+		}
+		if (!blob.empty()) {
+			RedisModule_SaveStringBuffer(rdb, blob.data(), blob.size());
+		}
+	}
+
+	virtual void rewrite(RedisModuleIO* aof, RedisModuleString* key) const {
+		RedisModule_EmitAOF(aof, "RingBufferCreate", "sl", key, size);
+		for (const_iterator it = cbegin(); it != cend(); ++it) {
+			RedisModule_EmitAOF(aof, "RingBufferWrite", "sb", key, data(*it), it->length);
+		}
+	}
+
+	inline const char* data(const Slot& slot) const {
+		return (arena + slot.offset);
+	}
+
+	inline void write_buffer(const char* payload, const size_t length) {
+		if (is_full()) {
+			read();
+		}
+		const size_t offset = reserve(length);
+		if (length) {
+			memcpy(arena + offset, payload, length);
+		}
+		arena_end = offset + length;
+		elements[b_end].offset = offset;
+		elements[b_end].length = length;
+		if (quantiles) {
+			sketch(elements[b_end], &std::RingBufferQuantileSketch::add);
 		}
-		elements[b_end] = RedisModule_CreateStringFromString(ctx, element);
 		post_write();
 	}
 
-	inline void on_load(const size_t start_, const size_t end_, const short int s_msb_, const short int e_msb_, RedisModuleString** elements_) {
+	inline Slot& read() {
+		if (quantiles) {
+			sketch(front(), &std::RingBufferQuantileSketch::remove);
+		}
+		return (Ring::read());
+	}
+
+	/*
+	 * Restores the cursors and the live payloads, given per physical slot.
+	 */
+	inline void on_load(const size_t start_, const size_t end_, const short int s_msb_, const short int e_msb_, char** payloads, const size_t* lengths) {
 		b_start = start_;
 		b_end = end_;
 		s_msb = s_msb_;
 		e_msb = e_msb_;
-		memcpy((void*)elements, (void*)elements_, size * an_element_size);
+		size_t bytes = 0;
+		for (size_t i = 0; i < length(); i++) {
+			bytes += lengths[slot(i)];
+		}
+		if (bytes) {
+			arena = (char*)RedisModule_Alloc(bytes);
+			arena_size = bytes;
+		}
+		for (size_t i = 0; i < length(); i++) {
+			const size_t p = slot(i);
+			if (lengths[p]) {
+				memcpy(arena + arena_end, payloads[p], lengths[p]);
+			}
+			elements[p].offset = arena_end;
+			elements[p].length = lengths[p];
+			arena_end += lengths[p];
+		}
 	}
 
-	inline void on_save(size_t& start_, size_t& end_, short int& s_msb_, short int& e_msb_, RedisModuleString** elements_) {
-		start_ = b_start;
-		end_ = b_end;
-		s_msb_ = s_msb;
-		e_msb_ = e_msb;
-		memcpy((void*)elements_, (void*)elements, size * an_element_size);
+protected:
+	virtual void fill_sketch() {
+		for (const_iterator it = cbegin(); it != cend(); ++it) {
+			sketch(*it, &std::RingBufferQuantileSketch::add);
+		}
 	}
 
 private:
-	RedisModuleCtx* ctx;
+	static const size_t ARENA_MIN_SIZE = 64;
+	static const size_t BLOB_SIZE = 64 * 1024;
+
+	char* arena;
+	size_t arena_size;
+	size_t arena_end;
+
+	/*
+	 * Sets the cursors for length elements stored from slot 0 on.
+	 */
+	inline void restore(const size_t length_) {
+		b_start = 0;
+		b_end = (length_ == size) ? 0 : length_;
+		s_msb = 0;
+		e_msb = (length_ == size) ? 1 : 0;
+	}
+
+	inline int reply_slot(RedisModuleCtx* ctx, const Slot& slot) const {
+		return (RedisModule_ReplyWithStringBuffer(ctx, data(slot), slot.length));
+	}
+
+	/*
+	 * Returns the arena offset for a new record of length bytes, growing the
+	 * arena when neither the tail nor the head gap can hold it. The live
+	 * region wraps when the back record lies before the front one; the tail
+	 * never catches up with the head, so the two cases stay distinct.
+	 */
+	inline size_t reserve(const size_t length) {
+		if (is_empty()) {
+			arena_end = 0;
+			if (length > arena_size) {
+				grow(length);
+			}
+			return (0);
+		}
+		const size_t start = front().offset;
+		if (back().offset >= start) {
+			if (arena_size - arena_end >= length) {
+				return (arena_end);
+			}
+			if (length < start) {
+				return (0);
+			}
+		} else if (start - arena_end > length) {
+			return (arena_end);
+		}
+		grow(length);
+		return (arena_end);
+	}
+
+	inline void grow(const size_t length) {
+		size_t live = 0;
+		for (size_t i = 0; i < this->length(); i++) {
+			live += elements[slot(i)].length;
+		}
+		const size_t bytes = std::max(std::max(2 * arena_size, live + length), ARENA_MIN_SIZE);
+		char* compacted = (char*)RedisModule_Alloc(bytes);
+		size_t end = 0;
+		for (size_t i = 0; i < this->length(); i++) {
+			Slot& record = elements[slot(i)];
+			if (record.length) {
+				memcpy(compacted + end, arena + record.offset, record.length);
+			}
+			record.offset = end;
+			end += record.length;
+		}
+		if (arena) {
+			RedisModule_Free(arena);
+		}
+		arena = compacted;
+		arena_size = bytes;
+		arena_end = end;
+	}
+
+	inline void sketch(const Slot& record, void (std::RingBufferQuantileSketch::*update)(double)) {
+		char number[64];
+		if ((record.length == 0) || (record.length >= sizeof (number))) {
+			return;
+		}
+		memcpy(number, data(record), record.length);
+		number[record.length] = '\0';
+		char* parsed = NULL;
+		const double value = strtod(number, &parsed);
+		if ((parsed == number + record.length) && !isspace((unsigned char)number[0])) {
+			(quantiles->*update)(value);
+		}
+	}
+};
+
+
+const size_t RedisStringRingBuffer::ARENA_MIN_SIZE;
+const size_t RedisStringRingBuffer::BLOB_SIZE;
+
+/*
+ * Typed numeric ring: values are parsed once on write and kept in a packed
+ * std::RingBuffer<T> array (T is int64_t or double). RDB bodies hold the raw
+ * values in host byte order.
+ */
+template <typename T>
+class RedisNumericRingBuffer : public RedisRingBuffer, public std::RingBuffer<T, 0, RedisModuleAllocator> {
+public:
+	typedef std::RingBuffer<T, 0, RedisModuleAllocator> Ring;
+
+	RedisNumericRingBuffer(const size_t size_) : Ring(size_) {
+	}
+
+	/*
+	 * Reads the encver 1 body: the cursors and the whole raw array.
+	 */
+	static RedisNumericRingBuffer* load_array(RedisModuleIO* rdb) {
+		const size_t size = (size_t)RedisModule_LoadUnsigned(rdb);
+		const size_t start = (size_t)RedisModule_LoadUnsigned(rdb);
+		const size_t end = (size_t)RedisModule_LoadUnsigned(rdb);
+		const short int s_msb = (short int)RedisModule_LoadSigned(rdb);
+		const short int e_msb = (short int)RedisModule_LoadSigned(rdb);
+		size_t bytes = 0;
+		char* values = RedisModule_LoadStringBuffer(rdb, &bytes);
+		if (bytes != size * sizeof (T)) {
+			RedisModule_Free(values);
+			return (NULL);
+		}
+		RedisNumericRingBuffer* buffer = new RedisNumericRingBuffer(size);
+		buffer->b_start = start;
+		buffer->b_end = end;
+		buffer->s_msb = s_msb;
+		buffer->e_msb = e_msb;
+		memcpy((void*)buffer->elements, values, bytes);
+		RedisModule_Free(values);
+		return (buffer);
+	}
+
+	/*
+	 * Reads the body written by save() straight into the array.
+	 */
+	static RedisNumericRingBuffer* load(RedisModuleIO* rdb) {
+		const size_t size = (size_t)RedisModule_LoadUnsigned(rdb);
+		const size_t length = (size_t)RedisModule_LoadUnsigned(rdb);
+		if (length > size) {
+			return (NULL);
+		}
+		RedisNumericRingBuffer* buffer = new RedisNumericRingBuffer(size);
+		size_t loaded = 0;
+		while (loaded < length) {
+			size_t bytes = 0;
+			char* values = RedisModule_LoadStringBuffer(rdb, &bytes);
+			const bool valid = (bytes > 0) && (bytes % sizeof (T) == 0) && (bytes / sizeof (T) <= length - loaded);
+			if (valid) {
+				memcpy((void*)(buffer->elements + loaded), values, bytes);
+				loaded += bytes / sizeof (T);
+			}
+			RedisModule_Free(values);
+			if (!valid) {
+				delete buffer;
+				return (NULL);
+			}
+		}
+		buffer->b_end = (length == size) ? 0 : length;
+		buffer->e_msb = (length == size) ? 1 : 0;
+		return (buffer);
+	}
+
+	virtual RedisRingBufferType type() const {
+		return (std::is_same<T, double>::value ? RING_BUFFER_DOUBLE : RING_BUFFER_INT64);
+	}
+
+	virtual size_t buffer_size() const {
+		return (Ring::buffer_size());
+	}
+
+	virtual size_t length() const {
+		return (Ring::length());
+	}
+
+	virtual bool is_full() const {
+		return (Ring::is_full());
+	}
+
+	virtual bool is_empty() const {
+		return (Ring::is_empty());
+	}
+
+	virtual void clear() {
+		Ring::clear();
+		if (quantiles) {
+			quantiles->clear();
+		}
+	}
+
+	virtual bool write(RedisModuleString** values, const int count) {
+		std::vector<T> parsed(count);
+		for (int i = 0; i < count; i++) {
+			if (!parse(values[i], parsed[i])) {
+				return (false);
+			}
+		}
+		for (int i = 0; i < count; i++) {
+			if (quantiles) {
+				if (is_full()) {
+					quantiles->remove((double)this->front());
+				}
+				quantiles->add((double)parsed[i]);
+			}
+			Ring::write(parsed[i]);
+		}
+		return (true);
+	}
+
+	virtual int reply(RedisModuleCtx* ctx, const size_t i) const {
+		return (reply_value(ctx, (*this)[i]));
+	}
+
+	virtual int reply_read(RedisModuleCtx* ctx) {
+		return (reply_value(ctx, pop()));
+	}
+
+	virtual void read_value(RedisRingBufferValue& value) {
+		value.set(pop());
+	}
+
+	virtual size_t memory_usage() const {
+		return (sizeof (RedisNumericRingBuffer) + this->size * sizeof (T) + (quantiles ? quantiles->bytes() : 0));
+	}
+
+	/*
+	 * Saves the live values only, oldest first, as one raw blob per
+	 * contiguous region of the ring.
+	 */
+	virtual void save(RedisModuleIO* rdb) const {
+		RedisModule_SaveUnsigned(rdb, this->size);
+		RedisModule_SaveUnsigned(rdb, this->length());
+		typename Ring::Span spans[2];
+		const size_t count = this->peek(spans);
+		for (size_t i = 0; i < count; i++) {
+			RedisModule_SaveStringBuffer(rdb, (const char*)spans[i].data, spans[i].length * sizeof (T));
+		}
+	}
+
+	virtual void rewrite(RedisModuleIO* aof, RedisModuleString* key) const {
+		RedisModule_EmitAOF(aof, "RingBufferCreate", "slcc", key, this->size, "TYPE", type_name());
+		char value[32];
+		for (typename Ring::const_iterator it = this->cbegin(); it != this->cend(); ++it) {
+			RedisModule_EmitAOF(aof, "RingBufferWrite", "sb", key, value, format(value, sizeof (value), *it));
+		}
+	}
+
+protected:
+	virtual void fill_sketch() {
+		for (typename Ring::const_iterator it = this->cbegin(); it != this->cend(); ++it) {
+			quantiles->add((double)*it);
+		}
+	}
+
+private:
+	inline T pop() {
+		if (quantiles) {
+			quantiles->remove((double)this->front());
+		}
+		return (Ring::read());
+	}
+
+	static inline const char* type_name() {
+		return (std::is_same<T, double>::value ? "double" : "int64");
+	}
+
+	static inline bool parse(const RedisModuleString* value, long long& parsed) {
+		return (RedisModule_StringToLongLong(value, &parsed) == REDISMODULE_OK);
+	}
+
+	static inline bool parse(const RedisModuleString* value, double& parsed) {
+		return (RedisModule_StringToDouble(value, &parsed) == REDISMODULE_OK);
+	}
+
+	static inline size_t format(char* buffer, const size_t length, const long long value) {
+		return ((size_t)snprintf(buffer, length, "%lld", value));
+	}
+
+	static inline size_t format(char* buffer, const size_t length, const double value) {
+		return ((size_t)snprintf(buffer, length, "%.17g", value));
+	}
+
+	static inline int reply_value(RedisModuleCtx* ctx, const long long value) {
+		return (RedisModule_ReplyWithLongLong(ctx, value));
+	}
+
+	static inline int reply_value(RedisModuleCtx* ctx, const double value) {
+		return (RedisModule_ReplyWithDouble(ctx, value));
+	}
 };
 
 static RedisModuleType* RingBufferType;
 
+/*
+ * encver 0 holds a string ring as cursors plus every slot; encver 1
+ * prefixes that body (or a raw numeric array) with the ring type; encver 2
+ * keeps the type prefix but saves only the live elements.
+ */
 void* RingBufferRdbLoad(RedisModuleIO* rdb, int encver) {
-	if (encver != 0) {
+	if (encver == 0) {
+		return ((void*)static_cast<RedisRingBuffer*>(RedisStringRingBuffer::load_slots(rdb)));
+	}
+	if ((encver != 1) && (encver != 2)) {
+		return NULL;
+	}
+	switch (RedisModule_LoadUnsigned(rdb)) {
+	case RING_BUFFER_STRING:
+		return ((void*)static_cast<RedisRingBuffer*>((encver == 1) ? RedisStringRingBuffer::load_slots(rdb) : RedisStringRingBuffer::load(rdb)));
+	case RING_BUFFER_INT64:
+		return ((void*)static_cast<RedisRingBuffer*>((encver == 1) ? RedisNumericRingBuffer<long long>::load_array(rdb) : RedisNumericRingBuffer<long long>::load(rdb)));
+	case RING_BUFFER_DOUBLE:
+		return ((void*)static_cast<RedisRingBuffer*>((encver == 1) ? RedisNumericRingBuffer<double>::load_array(rdb) : RedisNumericRingBuffer<double>::load(rdb)));
+	default:
 		return NULL;
 	}
-	size_t size = (size_t)RedisModule_LoadUnsigned(rdb);
-	size_t start = (size_t)RedisModule_LoadUnsigned(rdb);
-	size_t end = (size_t)RedisModule_LoadUnsigned(rdb);
-	short int s_msb = (short int)RedisModule_LoadSigned(rdb);
-	short int e_msb = (short int)RedisModule_LoadSigned(rdb);
-	RedisModuleString** elements = (RedisModuleString**)RedisModule_Alloc(sizeof(RedisModuleString*) * size);
-	for (size_t i = 0; i < size; i++) {
-		elements[i] = RedisModule_LoadString(rdb);
-		size_t len = 0;
-		RedisModule_StringPtrLen(elements[i], &len);
-		if (len == 0) {
-			elements[i] = NULL;
-		}
-	}
-	RedisRingBuffer* buffer = new RedisRingBuffer(RedisModule_GetContextFromIO(rdb), size);
-	buffer->on_load(start, end, s_msb, e_msb, elements);
-	RedisModule_Free(elements);
-	return ((void*)buffer);
 }
 
 void RingBufferRdbSave(RedisModuleIO *rdb, void* value) {
 	RedisRingBuffer* buffer = (RedisRingBuffer*)value;
-	size_t size = buffer->buffer_size();
-	RedisModule_SaveUnsigned(rdb, size);
-	size_t start = 0;
-	size_t end = 0;
-	short int s_msb = 0;
-	short int e_msb = 0;
-	RedisModuleString** elements = (RedisModuleString**)RedisModule_Alloc(sizeof(RedisModuleString*) * size);
-	buffer->on_save(start, end, s_msb, e_msb, elements);
-	RedisModule_SaveUnsigned(rdb, start);
-	RedisModule_SaveUnsigned(rdb, end);
-	RedisModule_SaveSigned(rdb, s_msb);
-	RedisModule_SaveSigned(rdb, e_msb);
-	for (size_t i = 0; i < size; i++) {
-		if (elements[i]) {
-			RedisModule_SaveString(rdb, elements[i]);
-		} else {
-			RedisModule_SaveString(rdb, RedisModule_CreateString(RedisModule_GetContextFromIO(rdb), "", 0));
-		}
-	}
-	RedisModule_Free(elements);
+	RedisModule_SaveUnsigned(rdb, buffer->type());
+	buffer->save(rdb);
 }
 
 void RingBufferAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
-	RedisRingBuffer* buffer = (RedisRingBuffer*)value;
-	RedisModule_EmitAOF(aof, "RingBufferCreate", "sl", key, buffer->buffer_size());
-	while (!buffer->end()) {
-		RedisModule_EmitAOF(aof, "RingBufferWrite", "ss", key, buffer->next());
-	}
+	((RedisRingBuffer*)value)->rewrite(aof, key);
 }
 
 size_t RingBufferMemUsage(const void *value) {
@@ -131,14 +743,193 @@ void RingBufferFree(void *value) {
 	delete (RedisRingBuffer*)value;
 }
 
+/*
+ * Clients parked by RingBufferBRead. Each waiter is queued on every key it
+ * watches, in arrival order. A write wakes one waiter per element of the key
+ * that is not already promised to an earlier wake-up, oldest waiter first,
+ * handing each one only the key; the element is popped in the reply
+ * callback, which Redis runs only for clients that are still connected.
+ * Until then it counts as a pending pop of the key and plain reads leave it
+ * alone. A wake-up that is never replied to (the client went away or timed
+ * out) passes its pending pop on to the next waiter. Keys are identified by
+ * "db:name".
+ */
+struct RedisRingBufferWaiter {
+	RedisModuleBlockedClient* client;
+	unsigned long long id;
+	std::vector<std::string> keys;
+};
+
+/*
+ * The key a woken waiter reads from; pending is cleared once its pop has
+ * been consumed or handed on.
+ */
+struct RedisRingBufferWakeUp {
+	int db;
+	std::string name;
+	std::string key;
+	bool pending;
+};
+
+static std::map<std::string, std::deque<RedisRingBufferWaiter*> > RingBufferWaiters;
+static std::map<unsigned long long, RedisRingBufferWaiter*> RingBufferWaitersById;
+static std::map<std::string, size_t> RingBufferPendingPops;
+
+static std::string RingBufferWaiterKey(const int db, const std::string& name) {
+	char prefix[32];
+	snprintf(prefix, sizeof (prefix), "%d:", db);
+	return (std::string(prefix) + name);
+}
+
+static std::string RingBufferName(RedisModuleString* name) {
+	size_t length = 0;
+	const char* data = RedisModule_StringPtrLen(name, &length);
+	return (std::string(data, length));
+}
+
+static std::string RingBufferWaiterKey(RedisModuleCtx* ctx, RedisModuleString* name) {
+	return (RingBufferWaiterKey(RedisModule_GetSelectedDb(ctx), RingBufferName(name)));
+}
+
+/*
+ * Elements of the ring that no woken client has been promised yet.
+ */
+static size_t RingBufferAvailable(RedisModuleCtx* ctx, RedisModuleString* name, const RedisRingBuffer* buffer) {
+	std::map<std::string, size_t>::const_iterator it = RingBufferPendingPops.find(RingBufferWaiterKey(ctx, name));
+	const size_t pending = (it == RingBufferPendingPops.end()) ? 0 : it->second;
+	return ((buffer->length() > pending) ? buffer->length() - pending : 0);
+}
+
+static void RingBufferForgetWaiter(RedisRingBufferWaiter* waiter) {
+	for (size_t i = 0; i < waiter->keys.size(); i++) {
+		std::map<std::string, std::deque<RedisRingBufferWaiter*> >::iterator queue = RingBufferWaiters.find(waiter->keys[i]);
+		if (queue == RingBufferWaiters.end()) {
+			continue;
+		}
+		queue->second.erase(std::remove(queue->second.begin(), queue->second.end(), waiter), queue->second.end());
+		if (queue->second.empty()) {
+			RingBufferWaiters.erase(queue);
+		}
+	}
+	RingBufferWaitersById.erase(waiter->id);
+}
+
+/*
+ * Wakes the oldest waiter of a key for one of its pending pops. Returns false
+ * if nobody waits on the key.
+ */
+static bool RingBufferWakeWaiter(const int db, const std::string& name) {
+	const std::string key = RingBufferWaiterKey(db, name);
+	std::map<std::string, std::deque<RedisRingBufferWaiter*> >::iterator queue = RingBufferWaiters.find(key);
+	if (queue == RingBufferWaiters.end()) {
+		return (false);
+	}
+	RedisRingBufferWaiter* waiter = queue->second.front();
+	RingBufferForgetWaiter(waiter);
+	RedisRingBufferWakeUp* wake_up = new RedisRingBufferWakeUp();
+	wake_up->db = db;
+	wake_up->name = name;
+	wake_up->key = key;
+	wake_up->pending = true;
+	RedisModule_UnblockClient(waiter->client, wake_up);
+	delete waiter;
+	return (true);
+}
+
+static void RingBufferDropPendingPop(RedisRingBufferWakeUp* wake_up) {
+	if (!wake_up->pending) {
+		return;
+	}
+	wake_up->pending = false;
+	std::map<std::string, size_t>::iterator it = RingBufferPendingPops.find(wake_up->key);
+	if ((it != RingBufferPendingPops.end()) && (--it->second == 0)) {
+		RingBufferPendingPops.erase(it);
+	}
+}
+
+/*
+ * Hands the pending pop of a wake-up that will not be replied to on to the
+ * next waiter of its key, or drops it if there is none.
+ */
+static void RingBufferPassOnPendingPop(RedisRingBufferWakeUp* wake_up) {
+	if (!wake_up->pending) {
+		return;
+	}
+	if (RingBufferWakeWaiter(wake_up->db, wake_up->name)) {
+		wake_up->pending = false;
+	} else {
+		RingBufferDropPendingPop(wake_up);
+	}
+}
+
+/*
+ * Wakes the waiters of a ring that was just written, oldest first, one per
+ * element nobody has been promised yet.
+ */
+static void RingBufferServeWaiters(RedisModuleCtx* ctx, RedisModuleString* name, const RedisRingBuffer* buffer) {
+	const int db = RedisModule_GetSelectedDb(ctx);
+	const std::string ring = RingBufferName(name);
+	for (size_t available = RingBufferAvailable(ctx, name, buffer); (available > 0) && RingBufferWakeWaiter(db, ring); available--) {
+		RingBufferPendingPops[RingBufferWaiterKey(db, ring)]++;
+	}
+}
+
+/*
+ * Pops the element promised to a woken client and replicates the pop as a
+ * RingBufferRead. Plain reads never take a promised element, so the ring
+ * can only have run dry if it was cleared, deleted or replaced since the
+ * wake-up; the bundled API cannot block the client again from here, so it
+ * gets nil in that case.
+ */
+int RingBufferBReadReply(RedisModuleCtx* ctx, RedisModuleString __attribute__((unused)) **argv, int __attribute__((unused)) argc) {
+	RedisModule_AutoMemory(ctx);
+	RedisRingBufferWakeUp* wake_up = (RedisRingBufferWakeUp*)RedisModule_GetBlockedClientPrivateData(ctx);
+	RingBufferDropPendingPop(wake_up);
+	RedisModule_SelectDb(ctx, wake_up->db);
+	RedisModuleString* name = RedisModule_CreateString(ctx, wake_up->name.data(), wake_up->name.size());
+	RedisModuleKey* key = (RedisModuleKey*)RedisModule_OpenKey(ctx, name, REDISMODULE_READ | REDISMODULE_WRITE);
+	if ((RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) || (RedisModule_ModuleTypeGetType(key) != RingBufferType)) {
+		return (RedisModule_ReplyWithNull(ctx));
+	}
+	RedisRingBuffer* buffer = (RedisRingBuffer*)RedisModule_ModuleTypeGetValue(key);
+	if (buffer->is_empty()) {
+		return (RedisModule_ReplyWithNull(ctx));
+	}
+	RedisRingBufferValue value;
+	value.key = wake_up->name;
+	buffer->read_value(value);
+	RedisModule_Replicate(ctx, "RingBufferRead", "s", name);
+	return (value.reply(ctx));
+}
+
+int RingBufferBReadTimeout(RedisModuleCtx* ctx, RedisModuleString __attribute__((unused)) **argv, int __attribute__((unused)) argc) {
+	RedisRingBufferWakeUp* wake_up = (RedisRingBufferWakeUp*)RedisModule_GetBlockedClientPrivateData(ctx);
+	if (wake_up) {
+		RingBufferPassOnPendingPop(wake_up);
+	}
+	std::map<unsigned long long, RedisRingBufferWaiter*>::iterator it = RingBufferWaitersById.find(RedisModule_GetClientId(ctx));
+	if (it != RingBufferWaitersById.end()) {
+		RedisRingBufferWaiter* waiter = it->second;
+		RingBufferForgetWaiter(waiter);
+		RedisModule_UnblockClient(waiter->client, NULL);
+		delete waiter;
+	}
+	return (RedisModule_ReplyWithNull(ctx));
+}
+
+void RingBufferBReadFree(void* wake_up) {
+	RingBufferPassOnPendingPop((RedisRingBufferWakeUp*)wake_up);
+	delete (RedisRingBufferWakeUp*)wake_up;
+}
+
 extern "C" {
 	/***
-	* usage: 	RingBufferCreate name, size
+	* usage: 	RingBufferCreate name, size [TYPE string|int64|double]
 	* returns: 	nil
 	*/
 	int RedisRingBuffer_Create_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
 		RedisModule_AutoMemory(ctx);
-		if (argc != 3) {
+		if ((argc != 3) && (argc != 5)) {
 			return RedisModule_WrongArity(ctx);
 		}
 		RedisModuleKey* key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
@@ -150,7 +941,23 @@ extern "C" {
 		if ((RedisModule_StringToLongLong(argv[2], &size) != REDISMODULE_OK) || (size <= 0)) {
 			return RedisModule_ReplyWithError(ctx, "invalid size: must be a natural number");
 		}
-		RedisRingBuffer* buffer = new RedisRingBuffer(ctx, (size_t)size);
+		const char* type_name = "string";
+		if (argc == 5) {
+			if (strcasecmp(RedisModule_StringPtrLen(argv[3], NULL), "TYPE") != 0) {
+				return RedisModule_ReplyWithError(ctx, "syntax error");
+			}
+			type_name = RedisModule_StringPtrLen(argv[4], NULL);
+		}
+		RedisRingBuffer* buffer;
+		if (strcasecmp(type_name, "string") == 0) {
+			buffer = new RedisStringRingBuffer((size_t)size);
+		} else if (strcasecmp(type_name, "int64") == 0) {
+			buffer = new RedisNumericRingBuffer<long long>((size_t)size);
+		} else if (strcasecmp(type_name, "double") == 0) {
+			buffer = new RedisNumericRingBuffer<double>((size_t)size);
+		} else {
+			return RedisModule_ReplyWithError(ctx, "invalid type: must be string, int64 or double");
+		}
 		RedisModule_ModuleTypeSetValue(key, RingBufferType, buffer);
 		RedisModule_ReplicateVerbatim(ctx);
 		return RedisModule_ReplyWithNull(ctx);
@@ -175,10 +982,12 @@ extern "C" {
 			return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
 		}
 		RedisRingBuffer* buffer = (RedisRingBuffer*)RedisModule_ModuleTypeGetValue(key);
-		for (int i = 2; i < argc; i++) {
-			buffer->write_string(argv[i]);
+		if (!buffer->write(argv + 2, argc - 2)) {
+			RedisModule_CloseKey(key);
+			return RedisModule_ReplyWithError(ctx, "invalid value: does not match the ring type");
 		}
 		RedisModule_ReplicateVerbatim(ctx);
+		RingBufferServeWaiters(ctx, argv[1], buffer);
 		RedisModule_CloseKey(key);
 		return RedisModule_ReplyWithNull(ctx);
 	}
@@ -203,12 +1012,11 @@ extern "C" {
 	*/
 	int RedisRingBuffer_Read_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
 		RING_BUFFER
-		if (buffer->is_empty()) {
+		if (RingBufferAvailable(ctx, argv[1], buffer) == 0) {
 			return RedisModule_ReplyWithNull(ctx);
 		} else {
-			RedisModuleString* value = buffer->read();
 			RedisModule_ReplicateVerbatim(ctx);
-			return RedisModule_ReplyWithString(ctx, value);
+			return buffer->reply_read(ctx);
 		}
 	}
 
@@ -257,7 +1065,7 @@ extern "C" {
 		if (buffer->is_empty()) {
 			return RedisModule_ReplyWithNull(ctx);
 		} else {
-			return RedisModule_ReplyWithString(ctx, buffer->front());
+			return buffer->reply(ctx, 0);
 		}
 	}
 
@@ -270,7 +1078,7 @@ extern "C" {
 		if (buffer->is_empty()) {
 			return RedisModule_ReplyWithNull(ctx);
 		} else {
-			return RedisModule_ReplyWithString(ctx, buffer->back());
+			return buffer->reply(ctx, buffer->length() - 1);
 		}
 	}
 
@@ -283,19 +1091,85 @@ extern "C" {
 		if (buffer->is_empty()) {
 			return RedisModule_ReplyWithNull(ctx);
 		} else {
-			RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
-			buffer->begin();
-			size_t length = 0;
-			while (!buffer->end()) {
-				RedisModule_ReplyWithString(ctx, buffer->next());
-				length++;
+			const size_t length = buffer->length();
+			RedisModule_ReplyWithArray(ctx, length);
+			for (size_t i = 0; i < length; i++) {
+				buffer->reply(ctx, i);
 			}
-			RedisModule_ReplySetArrayLength(ctx, length);
 			RedisModule_ReplicateVerbatim(ctx);
 			return REDISMODULE_OK;
 		}
 	}
 
+	/***
+	* usage: 	RingBufferRange name start stop
+	* returns: 	the elements from logical index start to stop, both inclusive, without removing them; negative indices count from the back (-1 is the newest)
+	*/
+	int RedisRingBuffer_Range_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+		RedisModule_AutoMemory(ctx);
+		if (argc != 4) {
+			return RedisModule_WrongArity(ctx);
+		}
+		RedisModuleKey* key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+		if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+			return RedisModule_ReplyWithError(ctx, "doesn't exist");
+		}
+		if (RedisModule_ModuleTypeGetType(key) != RingBufferType) {
+			return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+		}
+		long long start;
+		long long stop;
+		if ((RedisModule_StringToLongLong(argv[2], &start) != REDISMODULE_OK) || (RedisModule_StringToLongLong(argv[3], &stop) != REDISMODULE_OK)) {
+			return RedisModule_ReplyWithError(ctx, "invalid index: must be an integer");
+		}
+		RedisRingBuffer* buffer = (RedisRingBuffer*)RedisModule_ModuleTypeGetValue(key);
+		const long long length = (long long)buffer->length();
+		start = (start < 0) ? std::max(length + start, 0LL) : start;
+		stop = (stop < 0) ? length + stop : std::min(stop, length - 1);
+		if ((start > stop) || (start >= length)) {
+			return RedisModule_ReplyWithArray(ctx, 0);
+		}
+		RedisModule_ReplyWithArray(ctx, stop - start + 1);
+		for (long long i = start; i <= stop; i++) {
+			buffer->reply(ctx, (size_t)i);
+		}
+		return REDISMODULE_OK;
+	}
+
+	/***
+	* usage: 	RingBufferReadN name count
+	* returns: 	if the ring buffer is empty nil, otherwise a list of up to count values removed from the front
+	*/
+	int RedisRingBuffer_ReadN_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+		RedisModule_AutoMemory(ctx);
+		if (argc != 3) {
+			return RedisModule_WrongArity(ctx);
+		}
+		RedisModuleKey* key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+		if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+			return RedisModule_ReplyWithError(ctx, "doesn't exist");
+		}
+		if (RedisModule_ModuleTypeGetType(key) != RingBufferType) {
+			return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+		}
+		long long count;
+		if ((RedisModule_StringToLongLong(argv[2], &count) != REDISMODULE_OK) || (count <= 0)) {
+			return RedisModule_ReplyWithError(ctx, "invalid count: must be a natural number");
+		}
+		RedisRingBuffer* buffer = (RedisRingBuffer*)RedisModule_ModuleTypeGetValue(key);
+		const size_t available = RingBufferAvailable(ctx, argv[1], buffer);
+		if (available == 0) {
+			return RedisModule_ReplyWithNull(ctx);
+		}
+		const size_t length = std::min((size_t)count, available);
+		RedisModule_ReplyWithArray(ctx, length);
+		for (size_t i = 0; i < length; i++) {
+			buffer->reply_read(ctx);
+		}
+		RedisModule_ReplicateVerbatim(ctx);
+		return REDISMODULE_OK;
+	}
+
 	/***
 	* usage: 	RingBufferClear name
 	* returns: 	nil
@@ -306,6 +1180,85 @@ extern "C" {
 		return RedisModule_ReplyWithNull(ctx);
 	}
 
+	/***
+	* usage: 	RingBufferQuantile name q1 [q2 ... ]
+	* returns: 	a list with the value at each quantile (0 <= q <= 1) of the numeric elements, within 1% relative error; nil if there are none
+	*/
+	int RedisRingBuffer_Quantile_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+		RedisModule_AutoMemory(ctx);
+		if (argc < 3) {
+			return RedisModule_WrongArity(ctx);
+		}
+		RedisModuleKey* key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+		const int type = RedisModule_KeyType(key);
+		if (type == REDISMODULE_KEYTYPE_EMPTY) {
+			return RedisModule_ReplyWithError(ctx, "doesn't exist");
+		}
+		if (RedisModule_ModuleTypeGetType(key) != RingBufferType) {
+			return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+		}
+		RedisRingBuffer* buffer = (RedisRingBuffer*)RedisModule_ModuleTypeGetValue(key);
+		double q;
+		for (int i = 2; i < argc; i++) {
+			if ((RedisModule_StringToDouble(argv[i], &q) != REDISMODULE_OK) || (q < 0.0) || (q > 1.0)) {
+				return RedisModule_ReplyWithError(ctx, "invalid quantile: must be a number between 0 and 1");
+			}
+		}
+		if (buffer->numeric_length() == 0) {
+			return RedisModule_ReplyWithNull(ctx);
+		}
+		RedisModule_ReplyWithArray(ctx, argc - 2);
+		for (int i = 2; i < argc; i++) {
+			RedisModule_StringToDouble(argv[i], &q);
+			RedisModule_ReplyWithDouble(ctx, buffer->quantile(q));
+		}
+		return REDISMODULE_OK;
+	}
+
+	/***
+	* usage: 	RingBufferBRead name1 [name2 ... ] timeout
+	* returns: 	a (name, value) pair taken from the first non-empty ring buffer; otherwise blocks until a write lands on one of them, or returns nil after timeout seconds (0 blocks forever)
+	*/
+	int RedisRingBuffer_BRead_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+		RedisModule_AutoMemory(ctx);
+		if (argc < 3) {
+			return RedisModule_WrongArity(ctx);
+		}
+		double timeout;
+		if ((RedisModule_StringToDouble(argv[argc - 1], &timeout) != REDISMODULE_OK) || (timeout < 0.0)) {
+			return RedisModule_ReplyWithError(ctx, "invalid timeout: must be a non-negative number of seconds");
+		}
+		for (int i = 1; i < argc - 1; i++) {
+			RedisModuleKey* key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ | REDISMODULE_WRITE);
+			if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+				continue;
+			}
+			if (RedisModule_ModuleTypeGetType(key) != RingBufferType) {
+				return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+			}
+			RedisRingBuffer* buffer = (RedisRingBuffer*)RedisModule_ModuleTypeGetValue(key);
+			if (RingBufferAvailable(ctx, argv[i], buffer) > 0) {
+				RedisRingBufferValue value;
+				value.key = RingBufferName(argv[i]);
+				buffer->read_value(value);
+				RedisModule_Replicate(ctx, "RingBufferRead", "s", argv[i]);
+				return value.reply(ctx);
+			}
+		}
+		RedisRingBufferWaiter* waiter = new RedisRingBufferWaiter();
+		waiter->client = RedisModule_BlockClient(ctx, RingBufferBReadReply, RingBufferBReadTimeout, RingBufferBReadFree, (long long)ceil(timeout * 1000));
+		waiter->id = RedisModule_GetClientId(ctx);
+		for (int i = 1; i < argc - 1; i++) {
+			const std::string name = RingBufferWaiterKey(ctx, argv[i]);
+			if (std::find(waiter->keys.begin(), waiter->keys.end(), name) == waiter->keys.end()) {
+				waiter->keys.push_back(name);
+				RingBufferWaiters[name].push_back(waiter);
+			}
+		}
+		RingBufferWaitersById[waiter->id] = waiter;
+		return REDISMODULE_OK;
+	}
+
 #define CREATE_COMMAND(name, command, policy)	if (RedisModule_CreateCommand(ctx, name, command, policy, 1, 1, 1) == REDISMODULE_ERR) { \
 													return REDISMODULE_ERR; \
 												}
@@ -323,7 +1276,7 @@ extern "C" {
 			.digest = RingBufferDigest,
 			.free = RingBufferFree
 		};
-		RingBufferType = RedisModule_CreateDataType(ctx, "ringbuffr", 0, &tm);
+		RingBufferType = RedisModule_CreateDataType(ctx, "ringbuffr", 2, &tm);
 		if (RingBufferType == NULL) {
 			return REDISMODULE_ERR;
 		}
@@ -338,6 +1291,12 @@ extern "C" {
 		CREATE_COMMAND("RingBufferBack", RedisRingBuffer_Back_RedisCommand, "readonly");
 		CREATE_COMMAND("RingBufferReadAll", RedisRingBuffer_ReadAll_RedisCommand, "write");
 		CREATE_COMMAND("RingBufferClear", RedisRingBuffer_Clear_RedisCommand, "write");
+		CREATE_COMMAND("RingBufferRange", RedisRingBuffer_Range_RedisCommand, "readonly");
+		CREATE_COMMAND("RingBufferReadN", RedisRingBuffer_ReadN_RedisCommand, "write");
+		CREATE_COMMAND("RingBufferQuantile", RedisRingBuffer_Quantile_RedisCommand, "readonly");
+		if (RedisModule_CreateCommand(ctx, "RingBufferBRead", RedisRingBuffer_BRead_RedisCommand, "write", 1, -2, 1) == REDISMODULE_ERR) {
+			return REDISMODULE_ERR;
+		}
 		return REDISMODULE_OK;
 	}
 }
\ No newline at end of file
@@ -5,24 +5,300 @@
 #include <iostream>
 #include <iomanip>
 #include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <deque>
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <linux/futex.h>
+#include <climits>
+#include <ctime>
+#include <chrono>
+#include <limits>
 
 namespace std {
+/*
+ * Allocators for the RingBuffer storage. An allocator hands out and takes
+ * back raw bytes; the ring keeps one instance, so allocators may carry state
+ * (a NUMA node, a page policy).
+ */
+struct RingBufferMallocAllocator {
+    inline void* allocate(const size_t bytes) {
+        return (malloc(bytes));
+    }
+
+    inline void deallocate(void* p, const size_t) {
+        free(p);
+    }
+};
+
+/*
+ * Backs the ring with 2 MB pages to cut TLB misses on large scans: explicit
+ * hugetlbfs pages (MAP_HUGETLB) when requested and available, otherwise a
+ * 2 MB-aligned anonymous mapping marked MADV_HUGEPAGE for transparent huge
+ * pages.
+ */
+struct RingBufferHugePageAllocator {
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    bool explicit_pages;
+
+    RingBufferHugePageAllocator(const bool explicit_pages_ = false) : explicit_pages(explicit_pages_) {
+    }
+
+    inline void* allocate(const size_t bytes) {
+        const size_t length = rounded(bytes);
+        if (explicit_pages) {
+            void* p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                return (p);
+            }
+        }
+        char* area = (char*)mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (area == (char*)MAP_FAILED) {
+            return (NULL);
+        }
+        char* aligned = (char*)(((uintptr_t)area + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+        if (aligned != area) {
+            munmap(area, aligned - area);
+        }
+        munmap(aligned + length, (area + HUGE_PAGE_SIZE) - aligned);
+        madvise(aligned, length, MADV_HUGEPAGE);
+        return (aligned);
+    }
+
+    inline void deallocate(void* p, const size_t bytes) {
+        munmap(p, rounded(bytes));
+    }
+
+    static inline size_t rounded(const size_t bytes) {
+        return ((bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+    }
+};
+
+/*
+ * Places the ring on a NUMA node. With a node >= 0 the pages are bound to it
+ * with mbind(MPOL_BIND); with node -1 placement is left to the kernel's
+ * first-touch policy. prefault touches every page from the allocating
+ * thread, so first-touch puts the whole ring on that thread's node before
+ * the hot path starts.
+ */
+struct RingBufferNumaAllocator {
+    int node;
+    bool prefault;
+
+    RingBufferNumaAllocator(const int node_ = -1, const bool prefault_ = true) : node(node_), prefault(prefault_) {
+    }
+
+    inline void* allocate(const size_t bytes) {
+        const size_t length = rounded(bytes);
+        void* p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return (NULL);
+        }
+        if ((node >= 0) && (node < (int)(8 * sizeof (unsigned long)))) {
+            const unsigned long mask = 1UL << node;
+            syscall(SYS_mbind, p, length, MPOL_BIND, &mask, 8 * sizeof (unsigned long), 0);
+        }
+        if (prefault) {
+            const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+            for (size_t i = 0; i < length; i += page_size) {
+                ((volatile char*)p)[i] = 0;
+            }
+        }
+        return (p);
+    }
+
+    inline void deallocate(void* p, const size_t bytes) {
+        munmap(p, rounded(bytes));
+    }
+
+    static inline size_t rounded(const size_t bytes) {
+        const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+        return ((bytes + page_size - 1) / page_size * page_size);
+    }
+};
+
+template <typename T, size_t N = 0, typename Allocator = RingBufferMallocAllocator>
+class RingBuffer;
+
+/*
+ * Random-access iterator over any ring exposing operator[] by logical index
+ * (0 is the oldest element). It only holds the ring and a logical position,
+ * so any number of iterators can scan the same ring at once.
+ */
+template <typename Buffer, typename Value>
+class RingBufferIterator {
+public:
+    typedef random_access_iterator_tag iterator_category;
+    typedef typename remove_const<Value>::type value_type;
+    typedef ptrdiff_t difference_type;
+    typedef Value* pointer;
+    typedef Value& reference;
+
+    RingBufferIterator() : buffer(NULL), position(0) {
+    }
+
+    RingBufferIterator(Buffer* buffer_, const size_t position_) : buffer(buffer_), position(position_) {
+    }
+
+    template <typename OtherBuffer, typename OtherValue>
+    RingBufferIterator(const RingBufferIterator<OtherBuffer, OtherValue>& other) : buffer(other.buffer), position(other.position) {
+    }
+
+    inline reference operator*() const {
+        return ((*buffer)[position]);
+    }
+
+    inline pointer operator->() const {
+        return (&(*buffer)[position]);
+    }
+
+    inline reference operator[](const difference_type n) const {
+        return ((*buffer)[position + n]);
+    }
+
+    inline RingBufferIterator& operator++() {
+        ++position;
+        return (*this);
+    }
+
+    inline RingBufferIterator operator++(int) {
+        RingBufferIterator previous(*this);
+        ++position;
+        return (previous);
+    }
+
+    inline RingBufferIterator& operator--() {
+        --position;
+        return (*this);
+    }
+
+    inline RingBufferIterator operator--(int) {
+        RingBufferIterator previous(*this);
+        --position;
+        return (previous);
+    }
+
+    inline RingBufferIterator& operator+=(const difference_type n) {
+        position += n;
+        return (*this);
+    }
+
+    inline RingBufferIterator& operator-=(const difference_type n) {
+        position -= n;
+        return (*this);
+    }
+
+    inline RingBufferIterator operator+(const difference_type n) const {
+        return (RingBufferIterator(buffer, position + n));
+    }
+
+    friend inline RingBufferIterator operator+(const difference_type n, const RingBufferIterator& it) {
+        return (it + n);
+    }
+
+    inline RingBufferIterator operator-(const difference_type n) const {
+        return (RingBufferIterator(buffer, position - n));
+    }
+
+    inline difference_type operator-(const RingBufferIterator& other) const {
+        return ((difference_type)position - (difference_type)other.position);
+    }
+
+    inline bool operator==(const RingBufferIterator& other) const {
+        return (position == other.position);
+    }
+
+    inline bool operator!=(const RingBufferIterator& other) const {
+        return (position != other.position);
+    }
+
+    inline bool operator<(const RingBufferIterator& other) const {
+        return (position < other.position);
+    }
+
+    inline bool operator>(const RingBufferIterator& other) const {
+        return (position > other.position);
+    }
+
+    inline bool operator<=(const RingBufferIterator& other) const {
+        return (position <= other.position);
+    }
+
+    inline bool operator>=(const RingBufferIterator& other) const {
+        return (position >= other.position);
+    }
+
+private:
+    template <typename OtherBuffer, typename OtherValue>
+    friend class RingBufferIterator;
+
+    Buffer* buffer;
+    size_t position;
+};
+
+/*
+ * A contiguous run of slots inside a ring's storage.
+ */
 template <typename T>
-class RingBuffer {
+struct RingBufferSpan {
+    T* data;
+    size_t length;
+};
+
+/*
+ * A [first, last) pair of iterators, usable in range-based for loops.
+ */
+template <typename Iterator>
+struct RingBufferRange {
+    Iterator first;
+    Iterator last;
+
+    inline Iterator begin() const {
+        return (first);
+    }
+
+    inline Iterator end() const {
+        return (last);
+    }
+};
+
+template <typename T, typename Allocator>
+class RingBuffer<T, 0, Allocator> {
 public:
 
-    RingBuffer(const size_t size_, const size_t an_element_size_ = sizeof (T), const bool create_elements = true) : size(size_), an_element_size(an_element_size_) {
+    RingBuffer(const size_t size_, const size_t an_element_size_ = sizeof (T), const bool create_elements = true, const bool mirror = false, const Allocator& allocator_ = Allocator()) : size(size_), an_element_size(an_element_size_), mirrored(mirror), allocator(allocator_) {
         init(create_elements);
     }
 
-    RingBuffer(const size_t size_, const T& elem, const size_t element_size, const size_t an_element_size_ = sizeof (T), const bool create_elements = true) : size(size_), an_element_size(an_element_size_) {
+    RingBuffer(const size_t size_, const T& elem, const size_t element_size, const size_t an_element_size_ = sizeof (T), const bool create_elements = true) : size(size_), an_element_size(an_element_size_), mirrored(false), allocator() {
         init(create_elements);
         write(elem, element_size);
     }
 
     virtual ~RingBuffer() {
         if (elements) {
-            free(elements);
+            destroy_all(is_trivial_element());
+            if (mirrored) {
+                munmap((void*)elements, 2 * size * an_element_size);
+            } else {
+                allocator.deallocate(elements, size * an_element_size);
+            }
         }
     }
 
@@ -35,7 +311,7 @@ public:
     }
 
     inline void write(const T& element, const size_t size_ = sizeof (T)) {
-        memmove((void*) ((uint64_t) (&(elements[0])) + (uint64_t) (an_element_size * b_end)), (void*) &element, size_);
+        store(element, size_, is_trivial_element());
         post_write();
     }
 
@@ -43,6 +319,38 @@ public:
         return (read_from(b_start, s_msb));
     }
 
+    /*
+     * Constructs an element in place at the back, overwriting the oldest one
+     * when the buffer is full.
+     */
+    template <typename... Args>
+    inline T& emplace_back(Args&&... args) {
+        T* target = &elements[b_end];
+        emplace_at(target, integral_constant<bool, is_nothrow_constructible<T, Args...>::value>(), std::forward<Args>(args)...);
+        post_write();
+        return (*target);
+    }
+
+    inline void push(const T& element) {
+        emplace_back(element);
+    }
+
+    inline void push(T&& element) {
+        emplace_back(std::move(element));
+    }
+
+    /*
+     * Moves the oldest element out and releases its slot. Unlike read(), no
+     * reference into the buffer is kept, so resources held by the element are
+     * owned by the caller alone.
+     */
+    inline T pop() {
+        T value(std::move(elements[b_start]));
+        release(0, 1, is_trivial_element());
+        incr(b_start, s_msb);
+        return (value);
+    }
+
     inline T& front() const {
         return (elements[b_start]);
     }
@@ -65,24 +373,182 @@ public:
         return (size);
     }
 
+    inline bool is_mirrored() const {
+        return (mirrored);
+    }
+
     inline void begin() {
-        iterator = b_start;
+        b_iterator = b_start;
         iterator_msb = s_msb;
     }
 
     inline bool end() const {
-        return (is_at_end(iterator, iterator_msb));
+        return (is_at_end(b_iterator, iterator_msb));
     }
 
     inline T& next() {
-        return (read_from(iterator, iterator_msb));
+        return (read_from(b_iterator, iterator_msb));
     }
 
     inline void clear() {
+        release(0, length(), is_trivial_element());
         init(false);
     }
 
-    friend inline ostream& operator<<(ostream& os, const RingBuffer<T>& buffer) {
+    typedef RingBufferIterator<RingBuffer<T, 0, Allocator>, T> iterator;
+    typedef RingBufferIterator<const RingBuffer<T, 0, Allocator>, const T> const_iterator;
+
+    /*
+     * O(1) access by logical index, 0 being the oldest element.
+     */
+    inline T& operator[](const size_t i) {
+        return (elements[slot(i)]);
+    }
+
+    inline const T& operator[](const size_t i) const {
+        return (elements[slot(i)]);
+    }
+
+    inline T& at(const size_t i) {
+        check_index(i);
+        return (elements[slot(i)]);
+    }
+
+    inline const T& at(const size_t i) const {
+        check_index(i);
+        return (elements[slot(i)]);
+    }
+
+    inline const_iterator cbegin() const {
+        return (const_iterator(this, 0));
+    }
+
+    inline const_iterator cend() const {
+        return (const_iterator(this, length()));
+    }
+
+    /*
+     * begin()/end() drive the built-in cursor, so iterator pairs are handed
+     * out as ranges: range() covers the whole ring, range(first, last) the
+     * logical indexes [first, last), e.g. for scans split over threads.
+     */
+    inline RingBufferRange<iterator> range() {
+        return (range(0, length()));
+    }
+
+    inline RingBufferRange<const_iterator> range() const {
+        return (range(0, length()));
+    }
+
+    inline RingBufferRange<iterator> range(const size_t first, const size_t last) {
+        RingBufferRange<iterator> r = { iterator(this, first), iterator(this, last) };
+        return (r);
+    }
+
+    inline RingBufferRange<const_iterator> range(const size_t first, const size_t last) const {
+        RingBufferRange<const_iterator> r = { const_iterator(this, first), const_iterator(this, last) };
+        return (r);
+    }
+
+    typedef RingBufferSpan<T> Span;
+
+    /*
+     * Writes n elements with at most two memcpy calls around the wrap point,
+     * overwriting the oldest elements like write() does when there is no room.
+     */
+    inline void write_n(const T* source, size_t n) {
+        if (n > size) {
+            source += n - size;
+            n = size;
+        }
+        const size_t first = min(n, contiguous(b_end));
+        copy_in(elements + b_end, source, first, is_trivial_element());
+        copy_in(elements, source + first, n - first, is_trivial_element());
+        publish(n);
+    }
+
+    /*
+     * Fills spans with the slots the next n writes go to (n is capped at the
+     * buffer size), so elements can be built in place, and returns how many
+     * spans were filled. Nothing changes until publish(n); when the buffer
+     * has less than n free slots the oldest elements' slots are handed out
+     * and those elements are dropped by publish().
+     */
+    inline size_t claim(Span (&spans)[2], size_t n) const {
+        n = min(n, size);
+        if (n == 0) {
+            return (0);
+        }
+        const size_t first = min(n, contiguous(b_end));
+        spans[0].data = elements + b_end;
+        spans[0].length = first;
+        if (first == n) {
+            return (1);
+        }
+        spans[1].data = elements;
+        spans[1].length = n - first;
+        return (2);
+    }
+
+    /*
+     * Makes the first n claimed slots part of the buffer with one cursor
+     * update, overwriting the oldest elements if needed.
+     */
+    inline void publish(size_t n) {
+        n = min(n, size);
+        const size_t available = size - length();
+        advance(b_end, e_msb, n);
+        if (n > available) {
+            advance(b_start, s_msb, n - available);
+        }
+    }
+
+    /*
+     * Reads up to n elements into destination and returns how many were read.
+     */
+    inline size_t read_n(T* destination, size_t n) {
+        Span spans[2];
+        const size_t count = peek(spans);
+        size_t copied = 0;
+        for (size_t i = 0; (i < count) && (copied < n); i++) {
+            const size_t chunk = min(n - copied, spans[i].length);
+            copy_out(destination + copied, spans[i].data, chunk, is_trivial_element());
+            copied += chunk;
+        }
+        advance(b_start, s_msb, copied);
+        return (copied);
+    }
+
+    /*
+     * Fills spans with the one or two contiguous regions holding the readable
+     * elements, oldest first, and returns how many regions were filled. The
+     * elements stay in the buffer until consume() is called.
+     */
+    inline size_t peek(Span (&spans)[2]) const {
+        if (is_empty()) {
+            return (0);
+        }
+        spans[0].data = elements + b_start;
+        if ((b_start < b_end) || mirrored) {
+            spans[0].length = length();
+            return (1);
+        }
+        spans[0].length = size - b_start;
+        if (b_end == 0) {
+            return (1);
+        }
+        spans[1].data = elements;
+        spans[1].length = b_end;
+        return (2);
+    }
+
+    inline void consume(size_t n) {
+        n = min(n, length());
+        release(0, n, is_trivial_element());
+        advance(b_start, s_msb, n);
+    }
+
+    friend inline ostream& operator<<(ostream& os, const RingBuffer<T, 0, Allocator>& buffer) {
         os << "{ \"full\": \"" << boolalpha << buffer.is_full() <<
            "\", \"empty\": \"" << buffer.is_empty() << "\"" <<
            ", \"size\": " << buffer.size <<
@@ -99,16 +565,27 @@ public:
     }
 
 protected:
+    /*
+     * Trivially copyable elements live in raw storage and are moved around
+     * with memmove/memcpy. Any other T is default-constructed in every slot
+     * by init(), copied by assignment, reset to T() when it leaves the buffer
+     * through pop(), consume(), read_n() or clear(), and destroyed with the
+     * buffer.
+     */
+    typedef integral_constant<bool, is_trivially_copyable<T>::value> is_trivial_element;
+
     size_t size;
     size_t an_element_size;
     size_t b_start;
     size_t b_end;
     short int s_msb;
     short int e_msb;
-    size_t iterator;
+    size_t b_iterator;
     short int iterator_msb;
     size_t index;
     T* elements;
+    bool mirrored;
+    Allocator allocator;
 
     inline void incr(size_t& p, short int& msb) const {
         if (++p == size) {
@@ -124,16 +601,144 @@ protected:
         incr(b_end, e_msb);
     }
 
+    inline void advance(size_t& p, short int& msb, const size_t n) const {
+        p += n;
+        if (p >= size) {
+            msb ^= 1;
+            p -= size;
+        }
+    }
+
     inline void init(const bool create_elements = true) {
         b_start = 0;
         b_end = 0;
         s_msb = 0;
         e_msb = 0;
-        iterator = 0;
+        b_iterator = 0;
         iterator_msb = 0;
         index = 0;
         if (create_elements) {
-            elements = (T*)malloc(size * an_element_size);
+            if (!mirrored || !(elements = map_mirrored(size * an_element_size))) {
+                mirrored = false;
+                elements = (T*)allocator.allocate(size * an_element_size);
+            }
+            construct_all(is_trivial_element());
+        }
+    }
+
+    inline void construct_all(true_type) {
+    }
+
+    inline void construct_all(false_type) {
+        for (size_t i = 0; i < size; i++) {
+            new ((void*)&elements[i]) T();
+        }
+    }
+
+    inline void destroy_all(true_type) {
+    }
+
+    inline void destroy_all(false_type) {
+        for (size_t i = 0; i < size; i++) {
+            elements[i].~T();
+        }
+    }
+
+    inline void store(const T& element, const size_t size_, true_type) {
+        memmove((void*) ((uint64_t) (&(elements[0])) + (uint64_t) (an_element_size * b_end)), (void*) &element, size_);
+    }
+
+    inline void store(const T& element, const size_t, false_type) {
+        elements[b_end] = element;
+    }
+
+    template <typename... Args>
+    inline void emplace_at(T* target, true_type, Args&&... args) {
+        if (is_full()) {
+            // args may refer to the oldest element, which is the one in target.
+            emplace_at(target, false_type(), std::forward<Args>(args)...);
+        } else {
+            target->~T();
+            new ((void*)target) T(std::forward<Args>(args)...);
+        }
+    }
+
+    template <typename... Args>
+    inline void emplace_at(T* target, false_type, Args&&... args) {
+        *target = T(std::forward<Args>(args)...);
+    }
+
+    static inline void copy_in(T* destination, const T* source, const size_t n, true_type) {
+        memcpy((void*)destination, (void*)source, n * sizeof (T));
+    }
+
+    static inline void copy_in(T* destination, const T* source, const size_t n, false_type) {
+        std::copy(source, source + n, destination);
+    }
+
+    static inline void copy_out(T* destination, T* source, const size_t n, true_type) {
+        memcpy((void*)destination, (void*)source, n * sizeof (T));
+    }
+
+    static inline void copy_out(T* destination, T* source, const size_t n, false_type) {
+        for (size_t i = 0; i < n; i++) {
+            destination[i] = std::move(source[i]);
+            source[i] = T();
+        }
+    }
+
+    inline void release(const size_t, const size_t, true_type) {
+    }
+
+    inline void release(const size_t first, const size_t n, false_type) {
+        for (size_t i = 0; i < n; i++) {
+            elements[slot(first + i)] = T();
+        }
+    }
+
+    inline size_t contiguous(const size_t p) const {
+        return (mirrored ? size : size - p);
+    }
+
+    /*
+     * Maps the same memfd pages twice, back to back, so that any run of up to
+     * size slots starting anywhere in the first copy is one contiguous range.
+     * Returns NULL (and the caller falls back to malloc) when bytes is not a
+     * multiple of the page size or any of the system calls fail.
+     */
+    static T* map_mirrored(const size_t bytes) {
+        const long page_size = sysconf(_SC_PAGESIZE);
+        if ((bytes == 0) || (page_size <= 0) || (bytes % (size_t)page_size != 0)) {
+            return (NULL);
+        }
+        const int fd = memfd_create("ring_buffer", MFD_CLOEXEC);
+        if (fd < 0) {
+            return (NULL);
+        }
+        char* area = NULL;
+        if (ftruncate(fd, (off_t)bytes) == 0) {
+            void* reserved = mmap(NULL, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (reserved != MAP_FAILED) {
+                area = (char*)reserved;
+                if ((mmap(area, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+                        (mmap(area + bytes, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+                    munmap(reserved, 2 * bytes);
+                    area = NULL;
+                }
+            }
+        }
+        close(fd);
+        return ((T*)area);
+    }
+
+    inline size_t slot(const size_t i) const {
+        const size_t p = b_start + i;
+        return ((p >= size) ? p - size : p);
+    }
+
+    inline void check_index(const size_t i) const {
+        if (i >= length()) {
+            throw out_of_range("RingBuffer::at");
         }
     }
 
@@ -148,6 +753,2433 @@ protected:
     }
 };
 
+/*
+ * Fixed-capacity RingBuffer<T, N> with inline storage: no heap allocation
+ * (Allocator is unused), cursor-to-slot math is a constexpr modulo by N that
+ * the compiler folds, and the object holds no pointers to itself, so it is
+ * trivially copyable (and relocatable) whenever T is and can be embedded in
+ * other structs.
+ */
+template <typename T, size_t N, typename Allocator>
+class RingBuffer {
+public:
+
+    RingBuffer() : b_start(0), b_end(0), iterator(0) {
+    }
+
+    inline bool is_full() const {
+        return (length() == N);
+    }
+
+    inline bool is_empty() const {
+        return (b_end == b_start);
+    }
+
+    inline void write(const T& element, const size_t size_ = sizeof (T)) {
+        memmove((void*) &(elements[slot(b_end)]), (void*) &element, size_);
+        post_write();
+    }
+
+    inline T& read() {
+        return (elements[slot(b_start++)]);
+    }
+
+    inline T& front() {
+        return (elements[slot(b_start)]);
+    }
+
+    inline const T& front() const {
+        return (elements[slot(b_start)]);
+    }
+
+    inline T& back() {
+        return (elements[slot(b_end - 1)]);
+    }
+
+    inline const T& back() const {
+        return (elements[slot(b_end - 1)]);
+    }
+
+    inline size_t length() const {
+        return ((size_t)(b_end - b_start));
+    }
+
+    static constexpr size_t buffer_size() {
+        return (N);
+    }
+
+    inline void begin() {
+        iterator = b_start;
+    }
+
+    inline bool end() const {
+        return (iterator == b_end);
+    }
+
+    inline T& next() {
+        return (elements[slot(iterator++)]);
+    }
+
+    inline void clear() {
+        b_start = 0;
+        b_end = 0;
+        iterator = 0;
+    }
+
+    friend inline ostream& operator<<(ostream& os, const RingBuffer<T, N, Allocator>& buffer) {
+        os << "{ \"full\": \"" << boolalpha << buffer.is_full() <<
+           "\", \"empty\": \"" << buffer.is_empty() << "\"" <<
+           ", \"size\": " << buffer.buffer_size() <<
+           ", \"start\": " << buffer.b_start <<
+           ", \"end\": " << buffer.b_end <<
+           ", \"length\": " << buffer.length();
+        if (!buffer.is_empty()) {
+            os << ", \"front\": " << buffer.front() << ", \"back\": " << buffer.back();
+        }
+        os << " }";
+        return os;
+    }
+
+protected:
+    uint64_t b_start;
+    uint64_t b_end;
+    uint64_t iterator;
+    T elements[N];
+
+    static constexpr size_t slot(const uint64_t i) {
+        return ((size_t)(i % N));
+    }
+
+    inline void post_write() {
+        b_start += (uint64_t)is_full();
+        b_end++;
+    }
+};
+
+static const size_t RING_BUFFER_CACHE_LINE_SIZE = 64;
+
+inline size_t ring_buffer_round_up_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return (p);
+}
+
+/*
+ * RingBuffer variant for power-of-two capacities (other sizes are rejected).
+ * b_start and b_end are free-running 64-bit counters, slots are addressed with
+ * a mask and length() is simply b_end - b_start, so no operation needs to
+ * branch at the wrap point.
+ */
+template <typename T>
+class PowerOfTwoRingBuffer {
+public:
+
+    PowerOfTwoRingBuffer(const size_t size_) : size(checked_size(size_)), mask(size - 1) {
+        elements = (T*)malloc(size * sizeof (T));
+        init();
+    }
+
+    virtual ~PowerOfTwoRingBuffer() {
+        if (elements) {
+            free(elements);
+        }
+    }
+
+    inline bool is_full() const {
+        return (length() == size);
+    }
+
+    inline bool is_empty() const {
+        return (b_end == b_start);
+    }
+
+    inline void write(const T& element, const size_t size_ = sizeof (T)) {
+        memmove((void*) &(elements[b_end & mask]), (void*) &element, size_);
+        post_write();
+    }
+
+    inline T& read() {
+        return (elements[(b_start++) & mask]);
+    }
+
+    inline T& front() const {
+        return (elements[b_start & mask]);
+    }
+
+    inline T& back() const {
+        return (elements[(b_end - 1) & mask]);
+    }
+
+    inline size_t length() const {
+        return ((size_t)(b_end - b_start));
+    }
+
+    inline size_t buffer_size() const {
+        return (size);
+    }
+
+    inline void begin() {
+        iterator = b_start;
+    }
+
+    inline bool end() const {
+        return (iterator == b_end);
+    }
+
+    inline T& next() {
+        return (elements[(iterator++) & mask]);
+    }
+
+    inline void clear() {
+        init();
+    }
+
+    friend inline ostream& operator<<(ostream& os, const PowerOfTwoRingBuffer<T>& buffer) {
+        os << "{ \"full\": \"" << boolalpha << buffer.is_full() <<
+           "\", \"empty\": \"" << buffer.is_empty() << "\"" <<
+           ", \"size\": " << buffer.size <<
+           ", \"start\": " << buffer.b_start <<
+           ", \"end\": " << buffer.b_end <<
+           ", \"length\": " << buffer.length();
+        if (!buffer.is_empty()) {
+            os << ", \"front\": " << buffer.front() << ", \"back\": " << buffer.back();
+        }
+        os << " }";
+        return os;
+    }
+
+protected:
+    const size_t size;
+    const uint64_t mask;
+    uint64_t b_start;
+    uint64_t b_end;
+    uint64_t iterator;
+    T* elements;
+
+    inline void post_write() {
+        b_start += (uint64_t)is_full();
+        b_end++;
+    }
+
+    inline void init() {
+        b_start = 0;
+        b_end = 0;
+        iterator = 0;
+    }
+
+private:
+    PowerOfTwoRingBuffer(const PowerOfTwoRingBuffer&);
+    PowerOfTwoRingBuffer& operator=(const PowerOfTwoRingBuffer&);
+
+    static inline size_t checked_size(const size_t size_) {
+        if (size_ == 0 || (size_ & (size_ - 1)) != 0) {
+            throw invalid_argument("PowerOfTwoRingBuffer: size must be a power of two");
+        }
+        return (size_);
+    }
+};
+
+/*
+ * Ring of variable-length records stored back to back in one byte arena.
+ * Each record is a uint32_t length prefix followed by its payload, padded to
+ * 4 bytes. A record never wraps: when it does not fit before the end of the
+ * arena the tail is skipped with a padding marker. When the arena is full,
+ * write() evicts whole records from the front until the new one fits.
+ */
+class RecordRingBuffer {
+public:
+
+    struct Record {
+        const char* data;
+        size_t length;
+    };
+
+    class const_iterator {
+    public:
+        const_iterator(const RecordRingBuffer* buffer_, const uint64_t position_) : buffer(buffer_), position(position_) {
+            skip_padding();
+        }
+
+        inline Record operator*() const {
+            return (buffer->record_at(position));
+        }
+
+        inline const_iterator& operator++() {
+            position += record_size(buffer->length_at(position));
+            skip_padding();
+            return (*this);
+        }
+
+        inline bool operator==(const const_iterator& other) const {
+            return (position == other.position);
+        }
+
+        inline bool operator!=(const const_iterator& other) const {
+            return (position != other.position);
+        }
+
+    private:
+        const RecordRingBuffer* buffer;
+        uint64_t position;
+
+        inline void skip_padding() {
+            if (position != buffer->b_end) {
+                buffer->skip_padding(position);
+            }
+        }
+    };
+
+    RecordRingBuffer(const size_t size_) : size(align(size_)) {
+        arena = (char*)malloc(size);
+        init();
+    }
+
+    virtual ~RecordRingBuffer() {
+        if (arena) {
+            free(arena);
+        }
+    }
+
+    /*
+     * Appends a record, evicting the oldest ones if needed. Returns false if
+     * the record can never fit in the arena.
+     */
+    inline bool write(const void* data, const size_t length_) {
+        const size_t needed = record_size(length_);
+        if ((needed > size) || (length_ > PADDING - 1)) {
+            return (false);
+        }
+        if (count == 0) {
+            // Restart at the arena base so the record never needs padding.
+            b_start = b_end = 0;
+        }
+        const size_t to_end = size - offset(b_end);
+        size_t padding = (to_end < needed) ? to_end : 0;
+        while (size - bytes() < padding + needed) {
+            pop();
+            if (count == 0) {
+                b_start = b_end = 0;
+                padding = 0;
+            }
+        }
+        if (padding) {
+            store_length(b_end, PADDING);
+            b_end += padding;
+        }
+        store_length(b_end, (uint32_t)length_);
+        memcpy(arena + offset(b_end) + sizeof (uint32_t), data, length_);
+        b_end += needed;
+        count++;
+        return (true);
+    }
+
+    /*
+     * Removes the oldest record and returns it. The data stays valid until
+     * the next write().
+     */
+    inline Record read() {
+        const Record record = front();
+        pop();
+        return (record);
+    }
+
+    inline Record front() const {
+        uint64_t position = b_start;
+        skip_padding(position);
+        return (record_at(position));
+    }
+
+    inline void pop() {
+        skip_padding(b_start);
+        b_start += record_size(length_at(b_start));
+        count--;
+        if (count == 0) {
+            b_start = b_end;
+        }
+    }
+
+    inline const_iterator begin() const {
+        return (const_iterator(this, b_start));
+    }
+
+    inline const_iterator end() const {
+        return (const_iterator(this, b_end));
+    }
+
+    inline bool is_empty() const {
+        return (count == 0);
+    }
+
+    inline size_t length() const {
+        return (count);
+    }
+
+    inline size_t bytes() const {
+        return ((size_t)(b_end - b_start));
+    }
+
+    inline size_t buffer_size() const {
+        return (size);
+    }
+
+    inline void clear() {
+        init();
+    }
+
+protected:
+    static const uint32_t PADDING = 0xffffffff;
+
+    const size_t size;
+    uint64_t b_start;
+    uint64_t b_end;
+    size_t count;
+    char* arena;
+
+    static inline size_t align(const size_t n) {
+        return ((n + sizeof (uint32_t) - 1) & ~(sizeof (uint32_t) - 1));
+    }
+
+    static inline size_t record_size(const size_t length_) {
+        return (sizeof (uint32_t) + align(length_));
+    }
+
+    inline size_t offset(const uint64_t position) const {
+        return ((size_t)(position % size));
+    }
+
+    inline uint32_t length_at(const uint64_t position) const {
+        uint32_t length_;
+        memcpy(&length_, arena + offset(position), sizeof (uint32_t));
+        return (length_);
+    }
+
+    inline void store_length(const uint64_t position, const uint32_t length_) {
+        memcpy(arena + offset(position), &length_, sizeof (uint32_t));
+    }
+
+    inline Record record_at(const uint64_t position) const {
+        Record record;
+        record.data = arena + offset(position) + sizeof (uint32_t);
+        record.length = length_at(position);
+        return (record);
+    }
+
+    inline void skip_padding(uint64_t& position) const {
+        if (length_at(position) == PADDING) {
+            position += size - offset(position);
+        }
+    }
+
+    inline void init() {
+        b_start = 0;
+        b_end = 0;
+        count = 0;
+    }
+
+private:
+    RecordRingBuffer(const RecordRingBuffer&);
+    RecordRingBuffer& operator=(const RecordRingBuffer&);
+};
+
+/*
+ * Sliding-window statistics over the last size samples, maintained on every
+ * write instead of by scanning: sum, mean and variance add the new sample and
+ * remove the one it overwrites (Welford), and min/max come from monotonic
+ * deques of (sequence, value) pairs. Every query is O(1). Only the methods
+ * below may modify the window; the bulk and zero-copy writers of RingBuffer
+ * are hidden because they would bypass the aggregates.
+ */
+template <typename T>
+class AggregatingRingBuffer : public RingBuffer<T> {
+public:
+    typedef typename conditional<is_integral<T>::value, long long, long double>::type sum_type;
+
+    AggregatingRingBuffer(const size_t size_) : RingBuffer<T>(size_) {
+        reset();
+    }
+
+    inline void write(const T& element) {
+        if (this->is_full()) {
+            remove(this->front());
+        }
+        RingBuffer<T>::write(element);
+        add(element);
+    }
+
+    inline T& read() {
+        remove(this->front());
+        return (RingBuffer<T>::read());
+    }
+
+    inline void clear() {
+        RingBuffer<T>::clear();
+        reset();
+    }
+
+    inline sum_type sum() const {
+        return (total);
+    }
+
+    inline double mean() const {
+        return (count ? mean_ : 0.0);
+    }
+
+    /*
+     * Population variance of the window.
+     */
+    inline double variance() const {
+        return ((count > 1) ? (m2 > 0.0 ? m2 / count : 0.0) : 0.0);
+    }
+
+    inline double stddev() const {
+        return (sqrt(variance()));
+    }
+
+    /*
+     * Throw out_of_range when the window is empty.
+     */
+    inline const T& min() const {
+        if (minimums.empty()) {
+            throw out_of_range("AggregatingRingBuffer::min");
+        }
+        return (minimums.front().second);
+    }
+
+    inline const T& max() const {
+        if (maximums.empty()) {
+            throw out_of_range("AggregatingRingBuffer::max");
+        }
+        return (maximums.front().second);
+    }
+
+private:
+    using RingBuffer<T>::write_n;
+    using RingBuffer<T>::read_n;
+    using RingBuffer<T>::consume;
+    using RingBuffer<T>::claim;
+    using RingBuffer<T>::publish;
+    using RingBuffer<T>::emplace_back;
+    using RingBuffer<T>::push;
+    using RingBuffer<T>::pop;
+
+    sum_type total;
+    size_t count;
+    double mean_;
+    double m2;
+    uint64_t written;
+    uint64_t removed;
+    deque<pair<uint64_t, T> > minimums;
+    deque<pair<uint64_t, T> > maximums;
+
+    inline void add(const T& element) {
+        total += element;
+        count++;
+        const double x = (double)element;
+        const double delta = x - mean_;
+        mean_ += delta / count;
+        m2 += delta * (x - mean_);
+        while (!minimums.empty() && !(minimums.back().second < element)) {
+            minimums.pop_back();
+        }
+        minimums.push_back(make_pair(written, element));
+        while (!maximums.empty() && !(element < maximums.back().second)) {
+            maximums.pop_back();
+        }
+        maximums.push_back(make_pair(written, element));
+        written++;
+    }
+
+    inline void remove(const T& element) {
+        total -= element;
+        count--;
+        if (count == 0) {
+            mean_ = 0.0;
+            m2 = 0.0;
+        } else {
+            const double x = (double)element;
+            const double delta = x - mean_;
+            mean_ -= delta / count;
+            m2 -= delta * (x - mean_);
+        }
+        if (minimums.front().first == removed) {
+            minimums.pop_front();
+        }
+        if (maximums.front().first == removed) {
+            maximums.pop_front();
+        }
+        removed++;
+    }
+
+    inline void reset() {
+        total = 0;
+        count = 0;
+        mean_ = 0.0;
+        m2 = 0.0;
+        written = 0;
+        removed = 0;
+        minimums.clear();
+        maximums.clear();
+    }
+};
+
+/*
+ * Mergeable quantile sketch over a multiset of doubles, in the style of an
+ * HDR histogram: magnitudes are counted in logarithmic buckets of ratio
+ * gamma = (1 + accuracy) / (1 - accuracy), so every quantile is answered
+ * within relative error accuracy of an actual sample. Values can be removed
+ * as well as added, which lets the sketch follow a sliding window. Updates
+ * cost one log(); quantile queries are O(buckets). NaN is ignored and
+ * magnitudes below MIN_VALUE count as zero.
+ */
+class RingBufferQuantileSketch {
+public:
+    static constexpr double MIN_VALUE = 1e-9;
+
+    RingBufferQuantileSketch(const double accuracy_ = 0.01) : accuracy(accuracy_), gamma((1.0 + accuracy_) / (1.0 - accuracy_)), log_gamma(log(gamma)), zeros(0), total(0) {
+    }
+
+    inline void add(const double value) {
+        update(value, 1);
+    }
+
+    /*
+     * Removes one occurrence of value, which must have been added before.
+     */
+    inline void remove(const double value) {
+        update(value, -1);
+    }
+
+    inline void merge(const RingBufferQuantileSketch& other) {
+        if (other.accuracy != accuracy) {
+            throw invalid_argument("RingBufferQuantileSketch::merge: accuracy mismatch");
+        }
+        positives.merge(other.positives);
+        negatives.merge(other.negatives);
+        zeros += other.zeros;
+        total += other.total;
+    }
+
+    inline void clear() {
+        positives.clear();
+        negatives.clear();
+        zeros = 0;
+        total = 0;
+    }
+
+    inline uint64_t count() const {
+        return (total);
+    }
+
+    inline double relative_accuracy() const {
+        return (accuracy);
+    }
+
+    /*
+     * The value of rank floor(q * (count() - 1)) in sorted order, as
+     * nth_element would pick it, within the sketch accuracy. 0.0 when empty.
+     */
+    inline double quantile(double q) const {
+        if (total == 0) {
+            return (0.0);
+        }
+        q = (q < 0.0) ? 0.0 : ((q > 1.0) ? 1.0 : q);
+        const uint64_t rank = (uint64_t)(q * (total - 1));
+        uint64_t seen = 0;
+        for (size_t i = negatives.counts.size(); i-- > 0; ) {
+            seen += negatives.counts[i];
+            if (seen > rank) {
+                return (-representative(negatives.offset + (int)i));
+            }
+        }
+        seen += zeros;
+        if (seen > rank) {
+            return (0.0);
+        }
+        for (size_t i = 0; i < positives.counts.size(); i++) {
+            seen += positives.counts[i];
+            if (seen > rank) {
+                return (representative(positives.offset + (int)i));
+            }
+        }
+        return (representative(positives.offset + (int)positives.counts.size() - 1));
+    }
+
+    inline size_t bytes() const {
+        return (sizeof (*this) + (positives.counts.capacity() + negatives.counts.capacity()) * sizeof (uint64_t));
+    }
+
+private:
+    /*
+     * Dense counters for bucket indexes offset .. offset + counts.size(),
+     * grown on demand in either direction.
+     */
+    struct Store {
+        int offset;
+        vector<uint64_t> counts;
+
+        Store() : offset(0) {
+        }
+
+        inline void update(const int index, const int delta) {
+            if (counts.empty()) {
+                offset = index;
+                counts.push_back(0);
+            } else if (index < offset) {
+                counts.insert(counts.begin(), (size_t)(offset - index), 0);
+                offset = index;
+            } else if (index - offset >= (int)counts.size()) {
+                counts.resize((size_t)(index - offset) + 1, 0);
+            }
+            counts[index - offset] += delta;
+        }
+
+        inline void merge(const Store& other) {
+            for (size_t i = 0; i < other.counts.size(); i++) {
+                if (other.counts[i]) {
+                    update(other.offset + (int)i, 0);
+                    counts[other.offset + (int)i - offset] += other.counts[i];
+                }
+            }
+        }
+
+        inline void clear() {
+            offset = 0;
+            counts.clear();
+        }
+    };
+
+    double accuracy;
+    double gamma;
+    double log_gamma;
+    Store positives;
+    Store negatives;
+    uint64_t zeros;
+    uint64_t total;
+
+    inline void update(const double value, const int delta) {
+        if (value != value) {
+            return;
+        }
+        const double magnitude = min(fabs(value), numeric_limits<double>::max());
+        if (magnitude < MIN_VALUE) {
+            zeros += delta;
+        } else {
+            // Bucket i holds magnitudes in (gamma^(i - 1), gamma^i].
+            const int index = (int)ceil(log(magnitude) / log_gamma);
+            (value > 0 ? positives : negatives).update(index, delta);
+        }
+        total += delta;
+    }
+
+    inline double representative(const int index) const {
+        return (2.0 * pow(gamma, index) / (gamma + 1.0));
+    }
+};
+
+/*
+ * A ring whose contents are mirrored in a RingBufferQuantileSketch: each
+ * write adds the new sample and removes the one it overwrites, so quantiles
+ * of the current window are available without copying it out. As with
+ * AggregatingRingBuffer, the bulk and zero-copy writers are hidden.
+ */
+template <typename T>
+class QuantileRingBuffer : public RingBuffer<T> {
+public:
+    QuantileRingBuffer(const size_t size_, const double accuracy = 0.01) : RingBuffer<T>(size_), quantiles(accuracy) {
+    }
+
+    inline void write(const T& element) {
+        if (this->is_full()) {
+            quantiles.remove((double)this->front());
+        }
+        RingBuffer<T>::write(element);
+        quantiles.add((double)element);
+    }
+
+    inline T& read() {
+        quantiles.remove((double)this->front());
+        return (RingBuffer<T>::read());
+    }
+
+    inline void clear() {
+        RingBuffer<T>::clear();
+        quantiles.clear();
+    }
+
+    inline double quantile(const double q) const {
+        return (quantiles.quantile(q));
+    }
+
+    inline const RingBufferQuantileSketch& sketch() const {
+        return (quantiles);
+    }
+
+private:
+    using RingBuffer<T>::write_n;
+    using RingBuffer<T>::read_n;
+    using RingBuffer<T>::consume;
+    using RingBuffer<T>::claim;
+    using RingBuffer<T>::publish;
+    using RingBuffer<T>::emplace_back;
+    using RingBuffer<T>::push;
+    using RingBuffer<T>::pop;
+
+    RingBufferQuantileSketch quantiles;
+};
+
+/*
+ * Scan kernels for numeric rings (float, double, int64_t) that cannot be
+ * maintained incrementally. The wrap-aware next() loop does not vectorize, so
+ * the kernels run over the one or two contiguous regions returned by peek().
+ * Each kernel body is written once with GCC vector extensions over BYTES-wide
+ * vectors and compiled per instruction set through target attributes; the
+ * widest set the CPU supports is picked at runtime, with plain loops as the
+ * scalar fallback.
+ */
+enum RingBufferIsa {
+    RING_BUFFER_ISA_SCALAR,
+    RING_BUFFER_ISA_SSE,
+    RING_BUFFER_ISA_AVX2
+};
+
+inline RingBufferIsa ring_buffer_isa() {
+#if defined(__x86_64__) || defined(__i386__)
+    static const RingBufferIsa isa = __builtin_cpu_supports("avx2") ? RING_BUFFER_ISA_AVX2 : (__builtin_cpu_supports("sse4.2") ? RING_BUFFER_ISA_SSE : RING_BUFFER_ISA_SCALAR);
+    return (isa);
+#else
+    return (RING_BUFFER_ISA_SCALAR);
+#endif
+}
+
+#define RING_BUFFER_KERNEL inline __attribute__((always_inline))
+
+template <typename T, size_t BYTES>
+struct RingBufferVector {
+    static const size_t LANES = BYTES / sizeof (T);
+    typedef T type __attribute__((vector_size(BYTES)));
+    typedef decltype(type() > type()) mask;
+
+    // Vectors are passed by reference: returning one changes the ABI.
+    static RING_BUFFER_KERNEL void load(type& v, const T* p) {
+        memcpy(&v, p, sizeof (v));
+    }
+
+    static RING_BUFFER_KERNEL void broadcast(type& v, const T value) {
+        v = type() + value;
+    }
+};
+
+/*
+ * A kernel keeps its running result across the regions of a scan. vector()
+ * processes a whole number of BYTES-wide vectors from the front of the data
+ * and returns how many elements it consumed; scalar() processes the rest, or
+ * everything when no vector unit is available.
+ */
+template <typename T>
+struct RingBufferSumKernel {
+    T result;
+
+    RingBufferSumKernel() : result() {
+    }
+
+    template <size_t BYTES>
+    RING_BUFFER_KERNEL size_t vector(const T* data, const size_t n) {
+        typedef RingBufferVector<T, BYTES> V;
+        typename V::type first = typename V::type(), second = typename V::type(), x, y;
+        size_t i = 0;
+        for (; i + 2 * V::LANES <= n; i += 2 * V::LANES) {
+            V::load(x, data + i);
+            V::load(y, data + i + V::LANES);
+            first += x;
+            second += y;
+        }
+        first += second;
+        T total = result;
+        for (size_t k = 0; k < V::LANES; k++) {
+            total += first[k];
+        }
+        result = total;
+        return (i);
+    }
+
+    RING_BUFFER_KERNEL void scalar(const T* data, const size_t n) {
+        T total = result;
+        for (size_t i = 0; i < n; i++) {
+            total += data[i];
+        }
+        result = total;
+    }
+};
+
+/*
+ * Minimum (LESS) or maximum of the scanned elements; T() for an empty ring.
+ */
+template <typename T, bool LESS>
+struct RingBufferExtremeKernel {
+    T result;
+    bool seen;
+
+    RingBufferExtremeKernel() : result(), seen(false) {
+    }
+
+    template <size_t BYTES>
+    RING_BUFFER_KERNEL size_t vector(const T* data, const size_t n) {
+        typedef RingBufferVector<T, BYTES> V;
+        if (n < V::LANES) {
+            return (0);
+        }
+        if (!seen) {
+            result = data[0];
+            seen = true;
+        }
+        typename V::type best, x;
+        V::broadcast(best, result);
+        size_t i = 0;
+        for (; i + V::LANES <= n; i += V::LANES) {
+            V::load(x, data + i);
+            best = (LESS ? (x < best) : (x > best)) ? x : best;
+        }
+        for (size_t k = 0; k < V::LANES; k++) {
+            pick(best[k]);
+        }
+        return (i);
+    }
+
+    RING_BUFFER_KERNEL void scalar(const T* data, const size_t n) {
+        if (n == 0) {
+            return;
+        }
+        if (!seen) {
+            result = data[0];
+            seen = true;
+        }
+        for (size_t i = 0; i < n; i++) {
+            pick(data[i]);
+        }
+    }
+
+    inline void pick(const T x) {
+        if (LESS ? (x < result) : (x > result)) {
+            result = x;
+        }
+    }
+};
+
+template <typename T>
+struct RingBufferCountGreaterKernel {
+    T threshold;
+    size_t result;
+
+    RingBufferCountGreaterKernel(const T threshold_) : threshold(threshold_), result(0) {
+    }
+
+    template <size_t BYTES>
+    RING_BUFFER_KERNEL size_t vector(const T* data, const size_t n) {
+        typedef RingBufferVector<T, BYTES> V;
+        typename V::type limit, x;
+        V::broadcast(limit, threshold);
+        size_t i = 0;
+        while (i + V::LANES <= n) {
+            // Comparisons yield -1 per true lane; flush before a lane can overflow.
+            typename V::mask counts = typename V::mask();
+            const size_t stop = i + min((n - i) / V::LANES, (size_t)INT_MAX) * V::LANES;
+            for (; i < stop; i += V::LANES) {
+                V::load(x, data + i);
+                counts -= (x > limit);
+            }
+            for (size_t k = 0; k < V::LANES; k++) {
+                result += (size_t)counts[k];
+            }
+        }
+        return (i);
+    }
+
+    RING_BUFFER_KERNEL void scalar(const T* data, const size_t n) {
+        size_t count = result;
+        for (size_t i = 0; i < n; i++) {
+            count += (data[i] > threshold);
+        }
+        result = count;
+    }
+};
+
+/*
+ * Counts elements into equal-width buckets over [low, high). Values below
+ * low (and NaN) land in the first bucket and values at or above high in the
+ * last, so every element is counted exactly once. Bucket positions are
+ * computed in vectors; the increments themselves are scattered one by one.
+ */
+template <typename T>
+struct RingBufferHistogramKernel {
+    typedef typename conditional<is_same<T, float>::value, float, double>::type real;
+
+    real low;
+    real scale;
+    size_t buckets;
+    size_t* counts;
+
+    RingBufferHistogramKernel(const double low_, const double high, const size_t buckets_, size_t* counts_) : low((real)low_), scale((real)(buckets_ / (high - low_))), buckets(buckets_), counts(counts_) {
+    }
+
+    template <size_t BYTES>
+    RING_BUFFER_KERNEL size_t vector(const T* data, const size_t n) {
+        typedef RingBufferVector<T, BYTES> V;
+        typedef RingBufferVector<real, V::LANES * sizeof (real)> R;
+        typename R::type base, factor, last, position;
+        const typename R::type zero = typename R::type();
+        R::broadcast(base, low);
+        R::broadcast(factor, scale);
+        R::broadcast(last, (real)(buckets - 1));
+        typename V::type x;
+        size_t i = 0;
+        for (; i + V::LANES <= n; i += V::LANES) {
+            V::load(x, data + i);
+            position = (__builtin_convertvector(x, typename R::type) - base) * factor;
+            position = (position > zero) ? position : zero;
+            position = (position < last) ? position : last;
+            const typename R::mask bucket = __builtin_convertvector(position, typename R::mask);
+            for (size_t k = 0; k < V::LANES; k++) {
+                counts[bucket[k]]++;
+            }
+        }
+        return (i);
+    }
+
+    RING_BUFFER_KERNEL void scalar(const T* data, const size_t n) {
+        const real last = (real)(buckets - 1);
+        for (size_t i = 0; i < n; i++) {
+            real position = ((real)data[i] - low) * scale;
+            position = (position > 0) ? position : 0;
+            position = (position < last) ? position : last;
+            counts[(size_t)position]++;
+        }
+    }
+};
+
+template <typename Kernel, typename T>
+inline void ring_buffer_run_scalar(Kernel& kernel, const T* data, const size_t n) {
+    kernel.scalar(data, n);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+template <typename Kernel, typename T>
+__attribute__((target("sse4.2"))) void ring_buffer_run_sse(Kernel& kernel, const T* data, const size_t n) {
+    const size_t done = kernel.template vector<16>(data, n);
+    kernel.scalar(data + done, n - done);
+}
+
+template <typename Kernel, typename T>
+__attribute__((target("avx2"))) void ring_buffer_run_avx2(Kernel& kernel, const T* data, const size_t n) {
+    const size_t done = kernel.template vector<32>(data, n);
+    kernel.scalar(data + done, n - done);
+}
+#endif
+
+/*
+ * Runs kernel over the readable elements of buffer, oldest region first,
+ * with the requested instruction set or the best supported one below it.
+ */
+template <typename Kernel, typename T, typename Allocator>
+inline Kernel& ring_buffer_scan(const RingBuffer<T, 0, Allocator>& buffer, Kernel& kernel, RingBufferIsa isa = ring_buffer_isa()) {
+    typename RingBuffer<T, 0, Allocator>::Span spans[2];
+    const size_t count = buffer.peek(spans);
+    isa = min(isa, ring_buffer_isa());
+    for (size_t i = 0; i < count; i++) {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa == RING_BUFFER_ISA_AVX2) {
+            ring_buffer_run_avx2(kernel, spans[i].data, spans[i].length);
+            continue;
+        }
+        if (isa == RING_BUFFER_ISA_SSE) {
+            ring_buffer_run_sse(kernel, spans[i].data, spans[i].length);
+            continue;
+        }
+#endif
+        ring_buffer_run_scalar(kernel, spans[i].data, spans[i].length);
+    }
+    return (kernel);
+}
+
+template <typename T, typename Allocator>
+inline T ring_buffer_sum(const RingBuffer<T, 0, Allocator>& buffer, const RingBufferIsa isa = ring_buffer_isa()) {
+    RingBufferSumKernel<T> kernel;
+    return (ring_buffer_scan(buffer, kernel, isa).result);
+}
+
+template <typename T, typename Allocator>
+inline T ring_buffer_min(const RingBuffer<T, 0, Allocator>& buffer, const RingBufferIsa isa = ring_buffer_isa()) {
+    RingBufferExtremeKernel<T, true> kernel;
+    return (ring_buffer_scan(buffer, kernel, isa).result);
+}
+
+template <typename T, typename Allocator>
+inline T ring_buffer_max(const RingBuffer<T, 0, Allocator>& buffer, const RingBufferIsa isa = ring_buffer_isa()) {
+    RingBufferExtremeKernel<T, false> kernel;
+    return (ring_buffer_scan(buffer, kernel, isa).result);
+}
+
+template <typename T, typename Allocator>
+inline size_t ring_buffer_count_greater(const RingBuffer<T, 0, Allocator>& buffer, const T threshold, const RingBufferIsa isa = ring_buffer_isa()) {
+    RingBufferCountGreaterKernel<T> kernel(threshold);
+    return (ring_buffer_scan(buffer, kernel, isa).result);
+}
+
+/*
+ * Fills counts[0..buckets) with a histogram of the readable elements over
+ * buckets equal-width buckets spanning [low, high). Throws invalid_argument
+ * if buckets is 0 or the range is empty.
+ */
+template <typename T, typename Allocator>
+inline void ring_buffer_histogram(const RingBuffer<T, 0, Allocator>& buffer, const double low, const double high, const size_t buckets, size_t* counts, const RingBufferIsa isa = ring_buffer_isa()) {
+    if (buckets == 0 || !(low < high)) {
+        throw invalid_argument("ring_buffer_histogram: needs at least one bucket and low < high");
+    }
+    fill(counts, counts + buckets, (size_t)0);
+    RingBufferHistogramKernel<T> kernel(low, high, buckets, counts);
+    ring_buffer_scan(buffer, kernel, isa);
+}
+
+/*
+ * Wait strategies for the blocking read_wait()/write_wait() calls of the
+ * concurrent rings. wait(ready, deadline) returns once ready() holds (true)
+ * or the deadline has passed (false); notify() is called by the other side
+ * after every write or read and must be cheap when nobody is waiting.
+ */
+inline void ring_buffer_cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/*
+ * Busy-polls: lowest latency, burns a core while waiting.
+ */
+struct RingBufferSpinWait {
+    template <typename Ready>
+    inline bool wait(Ready ready, const chrono::steady_clock::time_point deadline) {
+        for (unsigned int i = 0; ; i++) {
+            if (ready()) {
+                return (true);
+            }
+            if (((i & 63) == 63) && (chrono::steady_clock::now() >= deadline)) {
+                return (ready());
+            }
+            ring_buffer_cpu_relax();
+        }
+    }
+
+    inline void notify() {
+    }
+};
+
+/*
+ * Spins for a short while, then yields the CPU between polls.
+ */
+struct RingBufferYieldWait {
+    static const unsigned int SPINS = 128;
+
+    template <typename Ready>
+    inline bool wait(Ready ready, const chrono::steady_clock::time_point deadline) {
+        for (unsigned int i = 0; ; i++) {
+            if (ready()) {
+                return (true);
+            }
+            if (i < SPINS) {
+                ring_buffer_cpu_relax();
+            } else if (chrono::steady_clock::now() >= deadline) {
+                return (ready());
+            } else {
+                this_thread::yield();
+            }
+        }
+    }
+
+    inline void notify() {
+    }
+};
+
+/*
+ * Spins briefly, then parks the thread on a futex. Waiters register
+ * themselves, so notify() costs a fence and a load, and only issues the
+ * FUTEX_WAKE system call when a waiter is actually parked.
+ */
+struct RingBufferFutexWait {
+    static const unsigned int SPINS = 128;
+
+    atomic<uint32_t> epoch;
+    atomic<uint32_t> waiters;
+
+    RingBufferFutexWait() {
+        epoch.store(0, memory_order_relaxed);
+        waiters.store(0, memory_order_relaxed);
+    }
+
+    template <typename Ready>
+    inline bool wait(Ready ready, const chrono::steady_clock::time_point deadline) {
+        for (unsigned int i = 0; i < SPINS; i++) {
+            if (ready()) {
+                return (true);
+            }
+            ring_buffer_cpu_relax();
+        }
+        waiters.fetch_add(1, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        bool result;
+        for (;;) {
+            const uint32_t current = epoch.load(memory_order_acquire);
+            if (ready()) {
+                result = true;
+                break;
+            }
+            const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if (now >= deadline) {
+                result = false;
+                break;
+            }
+            struct timespec timeout;
+            struct timespec* timeout_ptr = NULL;
+            if (deadline != chrono::steady_clock::time_point::max()) {
+                const chrono::nanoseconds left = chrono::duration_cast<chrono::nanoseconds>(deadline - now);
+                timeout.tv_sec = (time_t)(left.count() / 1000000000);
+                timeout.tv_nsec = (long)(left.count() % 1000000000);
+                timeout_ptr = &timeout;
+            }
+            syscall(SYS_futex, (uint32_t*)&epoch, FUTEX_WAIT_PRIVATE, current, timeout_ptr, NULL, 0);
+        }
+        waiters.fetch_sub(1, memory_order_relaxed);
+        return (result);
+    }
+
+    inline void notify() {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (waiters.load(memory_order_relaxed)) {
+            epoch.fetch_add(1, memory_order_release);
+            syscall(SYS_futex, (uint32_t*)&epoch, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+        }
+    }
+};
+
+inline chrono::steady_clock::time_point ring_buffer_deadline(const chrono::nanoseconds timeout) {
+    if (timeout == chrono::nanoseconds::max()) {
+        return (chrono::steady_clock::time_point::max());
+    }
+    return (chrono::steady_clock::now() + timeout);
+}
+
+/*
+ * Lock-free single-producer/single-consumer ring. Exactly one thread may call
+ * write() and exactly one (other) thread may call read(). The capacity is
+ * rounded up to a power of two; head and tail are free-running counters.
+ * read_wait()/write_wait() block through WaitStrategy; since the producer
+ * never touches head, a full ring always applies backpressure.
+ */
+template <typename T, typename WaitStrategy = RingBufferSpinWait>
+class SpscRingBuffer {
+public:
+
+    SpscRingBuffer(const size_t size_) : size(ring_buffer_round_up_pow2(size_)), mask(size - 1), elements(new T[size]) {
+        head.store(0, memory_order_relaxed);
+        tail.store(0, memory_order_relaxed);
+        cached_head = 0;
+        cached_tail = 0;
+    }
+
+    virtual ~SpscRingBuffer() {
+        delete[] elements;
+    }
+
+    inline bool write(const T& element) {
+        const size_t t = tail.load(memory_order_relaxed);
+        if (t - cached_head == size) {
+            cached_head = head.load(memory_order_acquire);
+            if (t - cached_head == size) {
+                return (false);
+            }
+        }
+        elements[t & mask] = element;
+        tail.store(t + 1, memory_order_release);
+        readable.notify();
+        return (true);
+    }
+
+    inline bool read(T& element) {
+        const size_t h = head.load(memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(memory_order_acquire);
+            if (h == cached_tail) {
+                return (false);
+            }
+        }
+        element = elements[h & mask];
+        head.store(h + 1, memory_order_release);
+        writable.notify();
+        return (true);
+    }
+
+    inline bool write_wait(const T& element, const chrono::nanoseconds timeout = chrono::nanoseconds::max()) {
+        if (write(element)) {
+            return (true);
+        }
+        const SpscRingBuffer* self = this;
+        return (writable.wait([self]() { return (!self->is_full()); }, ring_buffer_deadline(timeout)) && write(element));
+    }
+
+    inline bool read_wait(T& element, const chrono::nanoseconds timeout = chrono::nanoseconds::max()) {
+        if (read(element)) {
+            return (true);
+        }
+        const SpscRingBuffer* self = this;
+        return (readable.wait([self]() { return (!self->is_empty()); }, ring_buffer_deadline(timeout)) && read(element));
+    }
+
+    typedef RingBufferSpan<T> Span;
+
+    /*
+     * Producer side of the zero-copy API: fills spans with up to n free
+     * slots, which the producer fills in place, and returns how many spans
+     * were filled. publish(n) then makes the first n of them visible to the
+     * consumer with a single release store.
+     */
+    inline size_t claim(Span (&spans)[2], size_t n) {
+        const size_t t = tail.load(memory_order_relaxed);
+        if (size - (t - cached_head) < n) {
+            cached_head = head.load(memory_order_acquire);
+        }
+        n = min(n, size - (size_t)(t - cached_head));
+        return (spans_at(t, n, spans));
+    }
+
+    inline void publish(const size_t n) {
+        tail.store(tail.load(memory_order_relaxed) + n, memory_order_release);
+        readable.notify();
+    }
+
+    /*
+     * Consumer side: fills spans with every readable slot without copying
+     * and returns how many spans were filled. release(n) hands the first n
+     * of them back to the producer.
+     */
+    inline size_t peek(Span (&spans)[2]) {
+        const size_t h = head.load(memory_order_relaxed);
+        cached_tail = tail.load(memory_order_acquire);
+        return (spans_at(h, cached_tail - h, spans));
+    }
+
+    inline void release(const size_t n) {
+        head.store(head.load(memory_order_relaxed) + n, memory_order_release);
+        writable.notify();
+    }
+
+    inline bool is_full() const {
+        return (length() == size);
+    }
+
+    inline bool is_empty() const {
+        return (length() == 0);
+    }
+
+    inline size_t length() const {
+        const size_t h = head.load(memory_order_acquire);
+        const size_t t = tail.load(memory_order_acquire);
+        return ((t >= h) ? t - h : 0);
+    }
+
+    inline size_t buffer_size() const {
+        return (size);
+    }
+
+protected:
+    const size_t size;
+    const size_t mask;
+    T* const elements;
+    alignas(RING_BUFFER_CACHE_LINE_SIZE) atomic<size_t> head;
+    size_t cached_tail;
+    alignas(RING_BUFFER_CACHE_LINE_SIZE) atomic<size_t> tail;
+    size_t cached_head;
+    alignas(RING_BUFFER_CACHE_LINE_SIZE) WaitStrategy readable;
+    alignas(RING_BUFFER_CACHE_LINE_SIZE) WaitStrategy writable;
+
+    inline size_t spans_at(const size_t p, const size_t n, Span (&spans)[2]) const {
+        if (n == 0) {
+            return (0);
+        }
+        const size_t offset = p & mask;
+        const size_t first = min(n, size - offset);
+        spans[0].data = elements + offset;
+        spans[0].length = first;
+        if (first == n) {
+            return (1);
+        }
+        spans[1].data = elements;
+        spans[1].length = n - first;
+        return (2);
+    }
+
+private:
+    SpscRingBuffer(const SpscRingBuffer&);
+    SpscRingBuffer& operator=(const SpscRingBuffer&);
+};
+
+/*
+ * Bounded lock-free multi-producer/multi-consumer ring (Vyukov). Every slot
+ * carries a sequence number telling whether it is ready to be written or
+ * read for the current lap, so producers only contend on tail and consumers
+ * only on head. try_write() and try_read() never block; read_wait() and
+ * write_wait() block through WaitStrategy, giving backpressure on a full
+ * ring, while write_overwrite() keeps RingBuffer's overwrite-oldest
+ * behaviour by dropping the oldest element instead.
+ */
+template <typename T, typename WaitStrategy = RingBufferSpinWait>
+class MpmcRingBuffer {
+public:
+
+    MpmcRingBuffer(const size_t size_) : size(ring_buffer_round_up_pow2(size_)), mask(size - 1), slots(new Slot[size]) {
+        for (size_t i = 0; i < size; i++) {
+            slots[i].sequence.store(i, memory_order_relaxed);
+        }
+        head.store(0, memory_order_relaxed);
+        tail.store(0, memory_order_relaxed);
+    }
+
+    virtual ~MpmcRingBuffer() {
+        delete[] slots;
+    }
+
+    inline bool try_write(const T& element) {
+        size_t pos = tail.load(memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[pos & mask];
+            const size_t sequence = slot->sequence.load(memory_order_acquire);
+            const intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return (false);
+            } else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+        slot->element = element;
+        slot->sequence.store(pos + 1, memory_order_release);
+        readable.notify();
+        return (true);
+    }
+
+    inline bool try_read(T& element) {
+        size_t pos = head.load(memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[pos & mask];
+            const size_t sequence = slot->sequence.load(memory_order_acquire);
+            const intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return (false);
+            } else {
+                pos = head.load(memory_order_relaxed);
+            }
+        }
+        element = slot->element;
+        slot->sequence.store(pos + size, memory_order_release);
+        writable.notify();
+        return (true);
+    }
+
+    inline bool write_wait(const T& element, const chrono::nanoseconds timeout = chrono::nanoseconds::max()) {
+        const chrono::steady_clock::time_point deadline = ring_buffer_deadline(timeout);
+        const MpmcRingBuffer* self = this;
+        while (!try_write(element)) {
+            if (!writable.wait([self]() { return (!self->is_full()); }, deadline)) {
+                return (try_write(element));
+            }
+        }
+        return (true);
+    }
+
+    inline bool read_wait(T& element, const chrono::nanoseconds timeout = chrono::nanoseconds::max()) {
+        const chrono::steady_clock::time_point deadline = ring_buffer_deadline(timeout);
+        const MpmcRingBuffer* self = this;
+        while (!try_read(element)) {
+            if (!readable.wait([self]() { return (!self->is_empty()); }, deadline)) {
+                return (try_read(element));
+            }
+        }
+        return (true);
+    }
+
+    inline void write_overwrite(const T& element) {
+        T dropped;
+        while (!try_write(element)) {
+            try_read(dropped);
+        }
+    }
+
+    inline bool is_empty() const {
+        return (length() == 0);
+    }
+
+    inline bool is_full() const {
+        return (length() >= size);
+    }
+
+    inline size_t length() const {
+        const size_t h = head.load(memory_order_acquire);
+        const size_t t = tail.load(memory_order_acquire);
+        return ((t >= h) ? t - h : 0);
+    }
+
+    inline size_t buffer_size() const {
+        return (size);
+    }
+
+protected:
+    struct Slot {
+        atomic<size_t> sequence;
+        T element;
+    };
+
+    const size_t size;
+    const size_t mask;
+    Slot* const slots;
+    alignas(RING_BUFFER_CACHE_LINE_SIZE) atomic<size_t> head;
+    alignas(RING_BUFFER_CACHE_LINE_SIZE) atomic<size_t> tail;
+    alignas(RING_BUFFER_CACHE_LINE_SIZE) WaitStrategy readable;
+    alignas(RING_BUFFER_CACHE_LINE_SIZE) WaitStrategy writable;
+
+private:
+    MpmcRingBuffer(const MpmcRingBuffer&);
+    MpmcRingBuffer& operator=(const MpmcRingBuffer&);
+};
+
+/*
+ * Disruptor-style broadcast ring: one producer, a fixed number of consumers,
+ * each with its own sequence cursor. Every consumer sees every element; the
+ * producer only waits when the slowest consumer is a whole ring behind.
+ * add_dependency() makes a consumer wait on other consumers instead of the
+ * producer, so consumers can be chained into pipeline stages.
+ */
+template <typename T>
+class BroadcastRingBuffer {
+public:
+
+    BroadcastRingBuffer(const size_t size_, const size_t consumers_) : size(ring_buffer_round_up_pow2(size_)), mask(size - 1), consumers(consumers_), elements(new T[size]), cursors(new Sequence[consumers_]), dependencies(consumers_) {
+        published.store(0, memory_order_relaxed);
+        for (size_t i = 0; i < consumers; i++) {
+            cursors[i].value.store(0, memory_order_relaxed);
+        }
+        next = 0;
+        cached_minimum = 0;
+    }
+
+    virtual ~BroadcastRingBuffer() {
+        delete[] cursors;
+        delete[] elements;
+    }
+
+    /*
+     * Makes consumer only see elements that upstream has already processed.
+     * Must be set up before the first write.
+     */
+    inline void add_dependency(const size_t consumer, const size_t upstream) {
+        dependencies[consumer].push_back(upstream);
+    }
+
+    inline bool try_write(const T& element) {
+        if (next - cached_minimum >= size) {
+            cached_minimum = minimum_cursor();
+            if (next - cached_minimum >= size) {
+                return (false);
+            }
+        }
+        elements[next & mask] = element;
+        published.store(++next, memory_order_release);
+        return (true);
+    }
+
+    inline void write(const T& element) {
+        while (!try_write(element)) {
+            this_thread::yield();
+        }
+    }
+
+    /*
+     * Hands up to max available elements to callback(const T&) in place, then
+     * advances the consumer's cursor once for the whole batch. Returns the
+     * number of elements processed.
+     */
+    template <typename Callback>
+    inline size_t read(const size_t consumer, Callback callback, const size_t max = SIZE_MAX) {
+        const uint64_t sequence = cursors[consumer].value.load(memory_order_relaxed);
+        const size_t n = (size_t)min((uint64_t)max, barrier(consumer) - sequence);
+        for (size_t i = 0; i < n; i++) {
+            callback(elements[(sequence + i) & mask]);
+        }
+        if (n) {
+            cursors[consumer].value.store(sequence + n, memory_order_release);
+        }
+        return (n);
+    }
+
+    inline bool try_read(const size_t consumer, T& element) {
+        const uint64_t sequence = cursors[consumer].value.load(memory_order_relaxed);
+        if (sequence == barrier(consumer)) {
+            return (false);
+        }
+        element = elements[sequence & mask];
+        cursors[consumer].value.store(sequence + 1, memory_order_release);
+        return (true);
+    }
+
+    inline size_t available(const size_t consumer) const {
+        return ((size_t)(barrier(consumer) - cursors[consumer].value.load(memory_order_relaxed)));
+    }
+
+    inline uint64_t cursor() const {
+        return (published.load(memory_order_acquire));
+    }
+
+    inline uint64_t cursor(const size_t consumer) const {
+        return (cursors[consumer].value.load(memory_order_acquire));
+    }
+
+    inline size_t buffer_size() const {
+        return (size);
+    }
+
+    inline size_t consumer_count() const {
+        return (consumers);
+    }
+
+protected:
+    struct Sequence {
+        atomic<uint64_t> value;
+        char padding[RING_BUFFER_CACHE_LINE_SIZE - sizeof (atomic<uint64_t>)];
+    };
+
+    const size_t size;
+    const uint64_t mask;
+    const size_t consumers;
+    T* const elements;
+    Sequence* const cursors;
+    vector<vector<size_t> > dependencies;
+    alignas(RING_BUFFER_CACHE_LINE_SIZE) atomic<uint64_t> published;
+    alignas(RING_BUFFER_CACHE_LINE_SIZE) uint64_t next;
+    uint64_t cached_minimum;
+
+    inline uint64_t minimum_cursor() const {
+        uint64_t minimum = next;
+        for (size_t i = 0; i < consumers; i++) {
+            minimum = min(minimum, cursors[i].value.load(memory_order_acquire));
+        }
+        return (minimum);
+    }
+
+    inline uint64_t barrier(const size_t consumer) const {
+        const vector<size_t>& upstream = dependencies[consumer];
+        if (upstream.empty()) {
+            return (published.load(memory_order_acquire));
+        }
+        uint64_t limit = cursors[upstream[0]].value.load(memory_order_acquire);
+        for (size_t i = 1; i < upstream.size(); i++) {
+            limit = min(limit, cursors[upstream[i]].value.load(memory_order_acquire));
+        }
+        return (limit);
+    }
+
+private:
+    BroadcastRingBuffer(const BroadcastRingBuffer&);
+    BroadcastRingBuffer& operator=(const BroadcastRingBuffer&);
+};
+
+/*
+ * Lossy overwrite ring for one writer and any number of concurrent readers.
+ * Like RingBuffer::post_write() it keeps the latest size elements, but every
+ * slot carries a version (seqlock): the writer never waits, and readers
+ * detect a slot that was overwritten or torn while they copied it and skip
+ * it. Each reader keeps its own cursor, so readers do not affect each other.
+ * T must be trivially copyable.
+ */
+template <typename T>
+class SeqlockRingBuffer {
+public:
+
+    SeqlockRingBuffer(const size_t size_) : size(ring_buffer_round_up_pow2(size_)), mask(size - 1), slots(new Slot[size]) {
+        static_assert(is_trivially_copyable<T>::value, "SeqlockRingBuffer requires a trivially copyable T");
+        for (size_t i = 0; i < size; i++) {
+            slots[i].version.store(0, memory_order_relaxed);
+        }
+        head.store(0, memory_order_relaxed);
+    }
+
+    virtual ~SeqlockRingBuffer() {
+        delete[] slots;
+    }
+
+    inline void write(const T& element) {
+        const uint64_t sequence = head.load(memory_order_relaxed);
+        Slot& slot = slots[sequence & mask];
+        slot.version.store(2 * sequence + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        memcpy((void*)&slot.element, (const void*)&element, sizeof (T));
+        slot.version.store(2 * sequence + 2, memory_order_release);
+        head.store(sequence + 1, memory_order_release);
+    }
+
+    /*
+     * Copies the element written with the given sequence number. Returns
+     * false if it has not been written yet, was overwritten, or was being
+     * overwritten during the copy.
+     */
+    inline bool read(const uint64_t sequence, T& element) const {
+        const Slot& slot = slots[sequence & mask];
+        const uint64_t version = slot.version.load(memory_order_acquire);
+        if (version != 2 * sequence + 2) {
+            return (false);
+        }
+        memcpy((void*)&element, (const void*)&slot.element, sizeof (T));
+        atomic_thread_fence(memory_order_acquire);
+        return (slot.version.load(memory_order_relaxed) == version);
+    }
+
+    /*
+     * Reads the next element after cursor, skipping whatever the writer has
+     * overwritten in the meantime, and advances cursor past it. Returns false
+     * once the reader has caught up with the writer.
+     */
+    inline bool try_read(uint64_t& cursor, T& element) const {
+        for (;;) {
+            const uint64_t end = head.load(memory_order_acquire);
+            if (cursor >= end) {
+                return (false);
+            }
+            if (end - cursor > size) {
+                cursor = end - size;
+            }
+            if (read(cursor++, element)) {
+                return (true);
+            }
+        }
+    }
+
+    /*
+     * Copies up to n of the latest elements, oldest first, into destination
+     * and returns how many were copied consistently.
+     */
+    inline size_t read_latest(T* destination, const size_t n) const {
+        const uint64_t end = head.load(memory_order_acquire);
+        uint64_t cursor = end - min((uint64_t)min(n, size), end);
+        size_t copied = 0;
+        for (; cursor < end; cursor++) {
+            if (read(cursor, destination[copied])) {
+                copied++;
+            }
+        }
+        return (copied);
+    }
+
+    inline uint64_t cursor() const {
+        return (head.load(memory_order_acquire));
+    }
+
+    inline size_t length() const {
+        return ((size_t)min((uint64_t)size, head.load(memory_order_acquire)));
+    }
+
+    inline size_t buffer_size() const {
+        return (size);
+    }
+
+protected:
+    struct Slot {
+        atomic<uint64_t> version;
+        T element;
+    };
+
+    const size_t size;
+    const uint64_t mask;
+    Slot* const slots;
+    alignas(RING_BUFFER_CACHE_LINE_SIZE) atomic<uint64_t> head;
+
+private:
+    SeqlockRingBuffer(const SeqlockRingBuffer&);
+    SeqlockRingBuffer& operator=(const SeqlockRingBuffer&);
+};
+
+/*
+ * Sharded front end for many producer threads: each thread gets its own
+ * SpscRingBuffer shard, registered on its first write, so producers never
+ * share a cursor. Elements are stamped (by default with the steady clock)
+ * and a single consumer either drains whole shards at a time with drain()
+ * or merges the shards into one stream ordered by stamp with drain_ordered().
+ * Shards outlive their threads and are freed with the buffer; at most
+ * max_shards threads can register.
+ */
+template <typename T>
+class ShardedRingBuffer {
+public:
+
+    ShardedRingBuffer(const size_t shard_size_, const size_t max_shards_ = 64) : shard_size(shard_size_), max_shards(max_shards_), id(next_id()), shards(new atomic<Shard*>[max_shards_]), pending(max_shards_) {
+        for (size_t i = 0; i < max_shards; i++) {
+            shards[i].store(NULL, memory_order_relaxed);
+        }
+        registered.store(0, memory_order_relaxed);
+    }
+
+    virtual ~ShardedRingBuffer() {
+        for (size_t i = 0; i < max_shards; i++) {
+            free_shard(shards[i].load(memory_order_relaxed));
+        }
+        delete[] shards;
+    }
+
+    inline bool write(const T& element) {
+        return (write(element, (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count()));
+    }
+
+    /*
+     * Writes with an explicit stamp; stamps from one thread must not go
+     * backwards. Returns false if the thread's shard is full or no shard
+     * could be registered.
+     */
+    inline bool write(const T& element, const uint64_t stamp) {
+        Shard* shard = local_shard();
+        if (!shard) {
+            return (false);
+        }
+        Entry entry;
+        entry.stamp = stamp;
+        entry.element = element;
+        return (shard->write(entry));
+    }
+
+    /*
+     * Hands up to max elements to callback(const T&), emptying one shard
+     * before moving to the next. Cheapest drain, ordered only per thread.
+     */
+    template <typename Callback>
+    inline size_t drain(Callback callback, const size_t max = SIZE_MAX) {
+        const size_t count = min(registered.load(memory_order_acquire), max_shards);
+        size_t drained = 0;
+        for (size_t i = 0; (i < count) && (drained < max); i++) {
+            Shard* shard = shards[i].load(memory_order_acquire);
+            if (!shard) {
+                continue;
+            }
+            if (pending[i].valid) {
+                callback(pending[i].entry.element);
+                pending[i].valid = false;
+                drained++;
+            }
+            Entry entry;
+            while ((drained < max) && shard->read(entry)) {
+                callback(entry.element);
+                drained++;
+            }
+        }
+        return (drained);
+    }
+
+    /*
+     * Hands up to max elements to callback(const T&) in stamp order, merging
+     * the heads of all shards. Elements still in flight when the merge runs
+     * are picked up by the next call.
+     */
+    template <typename Callback>
+    inline size_t drain_ordered(Callback callback, const size_t max = SIZE_MAX) {
+        const size_t count = min(registered.load(memory_order_acquire), max_shards);
+        size_t drained = 0;
+        while (drained < max) {
+            size_t best = count;
+            for (size_t i = 0; i < count; i++) {
+                if (!fill(i)) {
+                    continue;
+                }
+                if ((best == count) || (pending[i].entry.stamp < pending[best].entry.stamp)) {
+                    best = i;
+                }
+            }
+            if (best == count) {
+                break;
+            }
+            callback(pending[best].entry.element);
+            pending[best].valid = false;
+            drained++;
+        }
+        return (drained);
+    }
+
+    inline size_t shard_count() const {
+        return (min(registered.load(memory_order_acquire), max_shards));
+    }
+
+    inline bool is_empty() const {
+        const size_t count = shard_count();
+        for (size_t i = 0; i < count; i++) {
+            Shard* shard = shards[i].load(memory_order_acquire);
+            if ((shard && !shard->is_empty()) || pending[i].valid) {
+                return (false);
+            }
+        }
+        return (true);
+    }
+
+protected:
+    struct Entry {
+        uint64_t stamp;
+        T element;
+    };
+
+    typedef SpscRingBuffer<Entry> Shard;
+
+    struct Pending {
+        Entry entry;
+        bool valid;
+
+        Pending() : valid(false) {
+        }
+    };
+
+    const size_t shard_size;
+    const size_t max_shards;
+    const uint64_t id;
+    atomic<Shard*>* const shards;
+    atomic<size_t> registered;
+    vector<Pending> pending;
+
+    static inline uint64_t next_id() {
+        static atomic<uint64_t> ids(1);
+        return (ids.fetch_add(1, memory_order_relaxed));
+    }
+
+    /*
+     * Shards are cache-line aligned, which plain new only honours from
+     * C++17 on, so they are placed in posix_memalign'd storage instead.
+     */
+    inline Shard* allocate_shard() const {
+        void* memory = NULL;
+        if (posix_memalign(&memory, alignof(Shard), sizeof(Shard)) != 0) {
+            throw bad_alloc();
+        }
+        try {
+            return (new (memory) Shard(shard_size));
+        } catch (...) {
+            free(memory);
+            throw;
+        }
+    }
+
+    static inline void free_shard(Shard* shard) {
+        if (shard) {
+            shard->~Shard();
+            free(shard);
+        }
+    }
+
+    inline Shard* local_shard() {
+        static thread_local vector<pair<uint64_t, Shard*> > local;
+        for (size_t i = 0; i < local.size(); i++) {
+            if (local[i].first == id) {
+                return (local[i].second);
+            }
+        }
+        const size_t index = registered.fetch_add(1, memory_order_acq_rel);
+        Shard* shard = (index < max_shards) ? allocate_shard() : NULL;
+        if (shard) {
+            shards[index].store(shard, memory_order_release);
+        }
+        local.push_back(make_pair(id, shard));
+        return (shard);
+    }
+
+    inline bool fill(const size_t i) {
+        if (!pending[i].valid) {
+            Shard* shard = shards[i].load(memory_order_acquire);
+            pending[i].valid = shard && shard->read(pending[i].entry);
+        }
+        return (pending[i].valid);
+    }
+
+private:
+    ShardedRingBuffer(const ShardedRingBuffer&);
+    ShardedRingBuffer& operator=(const ShardedRingBuffer&);
+};
+
+/*
+ * Flight-recorder ring kept in a file-backed shared mapping, so its contents
+ * survive the process. The file starts with a header holding the capacity,
+ * the element size and two cursor records, each with a generation and a
+ * checksum. Every write stores the element and then the alternate record,
+ * so a crash in the middle of an update leaves the previous record intact
+ * and reopening picks the newest valid record in O(1), without replaying
+ * anything. Data reaches the page cache immediately; flush() (or every
+ * sync_interval writes) adds an msync for durability across power loss.
+ * T must be trivially copyable.
+ */
+template <typename T>
+class PersistentRingBuffer {
+public:
+
+    PersistentRingBuffer(const char* path, const size_t size_, const size_t sync_interval_ = 0) : size(size_), sync_interval(sync_interval_), unsynced(0), recovered(false), b_start(0), b_end(0), generation(0), mapping(NULL), header(NULL), elements(NULL) {
+        static_assert(is_trivially_copyable<T>::value, "PersistentRingBuffer requires a trivially copyable T");
+        open_file(path);
+    }
+
+    virtual ~PersistentRingBuffer() {
+        if (mapping) {
+            if (sync_interval) {
+                flush();
+            }
+            munmap(mapping, mapped_size());
+        }
+    }
+
+    /*
+     * False if the file could not be opened or mapped, holds a ring with a
+     * different capacity or element size, or is not a ring file at all.
+     */
+    inline bool is_open() const {
+        return (mapping != NULL);
+    }
+
+    /*
+     * True if the contents were recovered from an existing file.
+     */
+    inline bool is_recovered() const {
+        return (recovered);
+    }
+
+    /*
+     * When the ring is full, the oldest element is retired by a commit of its
+     * own before its slot is overwritten, so a crash in between never
+     * recovers a front that already holds the newest sample.
+     */
+    inline void write(const T& element) {
+        if (b_end - b_start == size) {
+            b_start++;
+            commit();
+        }
+        memcpy((void*)&elements[b_end % size], (const void*)&element, sizeof (T));
+        b_end++;
+        commit();
+    }
+
+    inline T read() {
+        const T element = elements[b_start % size];
+        b_start++;
+        commit();
+        return (element);
+    }
+
+    inline const T& front() const {
+        return (elements[b_start % size]);
+    }
+
+    inline const T& back() const {
+        return (elements[(b_end - 1) % size]);
+    }
+
+    inline const T& operator[](const size_t i) const {
+        return (elements[(b_start + i) % size]);
+    }
+
+    inline bool is_full() const {
+        return (length() == size);
+    }
+
+    inline bool is_empty() const {
+        return (b_end == b_start);
+    }
+
+    inline size_t length() const {
+        return ((size_t)(b_end - b_start));
+    }
+
+    inline size_t buffer_size() const {
+        return (size);
+    }
+
+    inline void clear() {
+        b_start = b_end;
+        commit();
+    }
+
+    inline bool flush() {
+        unsynced = 0;
+        return (msync(mapping, mapped_size(), MS_SYNC) == 0);
+    }
+
+protected:
+    static const uint64_t MAGIC = 0x5246465542474e52ULL;
+    static const uint32_t VERSION = 1;
+
+    struct Cursor {
+        uint64_t generation;
+        uint64_t start;
+        uint64_t end;
+        uint64_t checksum;
+    };
+
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t element_size;
+        uint64_t size;
+        Cursor cursors[2];
+    };
+
+    const size_t size;
+    const size_t sync_interval;
+    size_t unsynced;
+    bool recovered;
+    uint64_t b_start;
+    uint64_t b_end;
+    uint64_t generation;
+    void* mapping;
+    Header* header;
+    T* elements;
+
+    static inline size_t data_offset() {
+        return ((sizeof (Header) + RING_BUFFER_CACHE_LINE_SIZE - 1) / RING_BUFFER_CACHE_LINE_SIZE * RING_BUFFER_CACHE_LINE_SIZE);
+    }
+
+    inline size_t mapped_size() const {
+        return (data_offset() + size * sizeof (T));
+    }
+
+    static inline uint64_t checksum(const Cursor& cursor) {
+        const uint64_t fields[3] = { cursor.generation, cursor.start, cursor.end };
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        const unsigned char* bytes = (const unsigned char*)fields;
+        for (size_t i = 0; i < sizeof (fields); i++) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+        }
+        return (hash);
+    }
+
+    inline bool valid(const Cursor& cursor) const {
+        return ((cursor.checksum == checksum(cursor)) && (cursor.start <= cursor.end) && (cursor.end - cursor.start <= size));
+    }
+
+    inline void commit() {
+        generation++;
+        Cursor& cursor = header->cursors[generation & 1];
+        atomic_signal_fence(memory_order_release);
+        cursor.generation = generation;
+        cursor.start = b_start;
+        cursor.end = b_end;
+        atomic_signal_fence(memory_order_release);
+        cursor.checksum = checksum(cursor);
+        if (sync_interval && (++unsynced >= sync_interval)) {
+            flush();
+        }
+    }
+
+    inline void open_file(const char* path) {
+        const int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        Header existing;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return;
+        }
+        existing.magic = 0;
+        if (st.st_size != 0) {
+            // Only a ring file, or one whose creation was interrupted before
+            // the magic was stored (right size, zero magic), may be opened;
+            // anything else is left untouched.
+            if (((size_t)st.st_size < sizeof (Header)) || (pread(fd, &existing, sizeof (Header), 0) != (ssize_t)sizeof (Header)) ||
+                    ((existing.magic != MAGIC) && ((existing.magic != 0) || ((size_t)st.st_size != mapped_size())))) {
+                close(fd);
+                return;
+            }
+            if ((existing.magic == MAGIC) && ((existing.version != VERSION) || (existing.element_size != sizeof (T)) || (existing.size != size) || ((size_t)st.st_size != mapped_size()))) {
+                close(fd);
+                return;
+            }
+        } else if (ftruncate(fd, (off_t)mapped_size()) != 0) {
+            close(fd);
+            return;
+        }
+        void* area = mmap(NULL, mapped_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (area == MAP_FAILED) {
+            return;
+        }
+        mapping = area;
+        header = (Header*)area;
+        elements = (T*)((char*)area + data_offset());
+        if (existing.magic) {
+            recover();
+        } else {
+            memset((void*)header, 0, sizeof (Header));
+            header->version = VERSION;
+            header->element_size = sizeof (T);
+            header->size = size;
+            commit();
+            atomic_signal_fence(memory_order_release);
+            header->magic = MAGIC;
+        }
+    }
+
+    inline void recover() {
+        const Cursor* best = NULL;
+        for (size_t i = 0; i < 2; i++) {
+            const Cursor& cursor = header->cursors[i];
+            if (valid(cursor) && (!best || (cursor.generation > best->generation))) {
+                best = &cursor;
+            }
+        }
+        b_start = best ? best->start : 0;
+        b_end = best ? best->end : 0;
+        generation = best ? best->generation : 0;
+        recovered = true;
+    }
+
+private:
+    PersistentRingBuffer(const PersistentRingBuffer&);
+    PersistentRingBuffer& operator=(const PersistentRingBuffer&);
+};
+
+/*
+ * Single-producer/single-consumer ring living in a named POSIX shared memory
+ * segment (/dev/shm), so two processes can exchange elements without copies
+ * through the kernel. The segment holds a header with the capacity, the
+ * element size, the offset of the slots from the start of the segment (no
+ * pointers, so every process may map it at a different address) and the
+ * head/tail cursors as lock-free, and therefore process-shared, atomics.
+ * One process creates the segment, the other attaches to it by name. The
+ * capacity is rounded up to a power of two and T must be trivially copyable.
+ */
+template <typename T>
+class SharedRingBuffer {
+public:
+
+    typedef RingBufferSpan<T> Span;
+
+    /*
+     * Creates the segment; fails (is_open() is false) if it already exists.
+     * The creator removes the name again when it is destroyed.
+     */
+    SharedRingBuffer(const char* name_, const size_t size_) : name(name_), owner(true), mapping(NULL), mapped_size(0), header(NULL), elements(NULL), cached_head(0), cached_tail(0) {
+        static_assert(is_trivially_copyable<T>::value, "SharedRingBuffer requires a trivially copyable T");
+        create(ring_buffer_round_up_pow2(size_));
+    }
+
+    /*
+     * Attaches to a segment created by another process.
+     */
+    SharedRingBuffer(const char* name_) : name(name_), owner(false), mapping(NULL), mapped_size(0), header(NULL), elements(NULL), cached_head(0), cached_tail(0) {
+        static_assert(is_trivially_copyable<T>::value, "SharedRingBuffer requires a trivially copyable T");
+        attach();
+    }
+
+    virtual ~SharedRingBuffer() {
+        if (mapping) {
+            munmap(mapping, mapped_size);
+        }
+        if (owner && mapping) {
+            shm_unlink(name.c_str());
+        }
+    }
+
+    static inline bool remove(const char* name_) {
+        return (shm_unlink(name_) == 0);
+    }
+
+    inline bool is_open() const {
+        return (mapping != NULL);
+    }
+
+    inline bool write(const T& element) {
+        Span spans[2];
+        if (claim(spans, 1) == 0) {
+            return (false);
+        }
+        memcpy((void*)spans[0].data, (const void*)&element, sizeof (T));
+        publish(1);
+        return (true);
+    }
+
+    inline bool read(T& element) {
+        Span spans[2];
+        if (peek(spans) == 0) {
+            return (false);
+        }
+        memcpy((void*)&element, (const void*)spans[0].data, sizeof (T));
+        release(1);
+        return (true);
+    }
+
+    /*
+     * Producer side: up to n free slots to fill in place, made visible to the
+     * other process by publish(n).
+     */
+    inline size_t claim(Span (&spans)[2], size_t n) {
+        const uint64_t t = header->tail.load(memory_order_relaxed);
+        if (size() - (t - cached_head) < n) {
+            cached_head = header->head.load(memory_order_acquire);
+        }
+        n = min(n, size() - (size_t)(t - cached_head));
+        return (spans_at(t, n, spans));
+    }
+
+    inline void publish(const size_t n) {
+        header->tail.store(header->tail.load(memory_order_relaxed) + n, memory_order_release);
+    }
+
+    /*
+     * Consumer side: the readable slots, handed back by release(n).
+     */
+    inline size_t peek(Span (&spans)[2]) {
+        const uint64_t h = header->head.load(memory_order_relaxed);
+        cached_tail = header->tail.load(memory_order_acquire);
+        return (spans_at(h, (size_t)(cached_tail - h), spans));
+    }
+
+    inline void release(const size_t n) {
+        header->head.store(header->head.load(memory_order_relaxed) + n, memory_order_release);
+    }
+
+    inline bool is_empty() const {
+        return (length() == 0);
+    }
+
+    inline bool is_full() const {
+        return (length() == size());
+    }
+
+    inline size_t length() const {
+        const uint64_t h = header->head.load(memory_order_acquire);
+        const uint64_t t = header->tail.load(memory_order_acquire);
+        return ((size_t)((t >= h) ? t - h : 0));
+    }
+
+    inline size_t buffer_size() const {
+        return (size());
+    }
+
+protected:
+    static const uint64_t MAGIC = 0x52534842474e5252ULL;
+    static const uint32_t VERSION = 1;
+
+    struct Header {
+        atomic<uint64_t> magic;
+        uint32_t version;
+        uint32_t element_size;
+        uint64_t size;
+        uint64_t data_offset;
+        alignas(RING_BUFFER_CACHE_LINE_SIZE) atomic<uint64_t> head;
+        alignas(RING_BUFFER_CACHE_LINE_SIZE) atomic<uint64_t> tail;
+    };
+
+    // Address-free (lock-free) atomics are required to share the header
+    // between processes.
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "SharedRingBuffer requires lock-free 64-bit atomics");
+
+    const string name;
+    const bool owner;
+    void* mapping;
+    size_t mapped_size;
+    Header* header;
+    T* elements;
+    uint64_t cached_head;
+    uint64_t cached_tail;
+
+    inline size_t size() const {
+        return ((size_t)header->size);
+    }
+
+    static inline size_t data_offset() {
+        return ((sizeof (Header) + RING_BUFFER_CACHE_LINE_SIZE - 1) / RING_BUFFER_CACHE_LINE_SIZE * RING_BUFFER_CACHE_LINE_SIZE);
+    }
+
+    inline void create(const size_t size_) {
+        const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            return;
+        }
+        const size_t bytes = data_offset() + size_ * sizeof (T);
+        void* area = MAP_FAILED;
+        if (ftruncate(fd, (off_t)bytes) == 0) {
+            area = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (area == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            return;
+        }
+        map(area, bytes, data_offset());
+        header->version = VERSION;
+        header->element_size = sizeof (T);
+        header->size = size_;
+        header->data_offset = data_offset();
+        header->head.store(0, memory_order_relaxed);
+        header->tail.store(0, memory_order_relaxed);
+        header->magic.store(MAGIC, memory_order_release);
+    }
+
+    inline void attach() {
+        const int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        void* area = MAP_FAILED;
+        if ((fstat(fd, &st) == 0) && ((size_t)st.st_size >= data_offset())) {
+            area = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (area == MAP_FAILED) {
+            return;
+        }
+        const Header* candidate = (const Header*)area;
+        if ((candidate->magic.load(memory_order_acquire) != MAGIC) || (candidate->version != VERSION) || (candidate->element_size != sizeof (T)) ||
+                (candidate->data_offset + candidate->size * sizeof (T) > (size_t)st.st_size)) {
+            munmap(area, (size_t)st.st_size);
+            return;
+        }
+        map(area, (size_t)st.st_size, (size_t)candidate->data_offset);
+    }
+
+    inline void map(void* area, const size_t bytes, const size_t offset) {
+        mapping = area;
+        mapped_size = bytes;
+        header = (Header*)area;
+        elements = (T*)((char*)area + offset);
+    }
+
+    inline size_t spans_at(const uint64_t p, const size_t n, Span (&spans)[2]) const {
+        if (n == 0) {
+            return (0);
+        }
+        const size_t offset = (size_t)(p & (header->size - 1));
+        const size_t first = min(n, size() - offset);
+        spans[0].data = elements + offset;
+        spans[0].length = first;
+        if (first == n) {
+            return (1);
+        }
+        spans[1].data = elements;
+        spans[1].length = n - first;
+        return (2);
+    }
+
+private:
+    SharedRingBuffer(const SharedRingBuffer&);
+    SharedRingBuffer& operator=(const SharedRingBuffer&);
+};
+
 }
 
 #endif
\ No newline at end of file
@@ -1,9 +1,20 @@
 #include "ring_buffer.h"
 #include <cassert>
+#include <csignal>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <type_traits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <memory>
 
 const std::size_t SIZE = 4;
 
-int base_test_ring_buffer(std::RingBuffer<int>& buffer) {
+template <typename Buffer>
+int base_test_ring_buffer(Buffer& buffer) {
     assert(buffer.buffer_size() == SIZE);
     assert(buffer.is_empty());
     assert(!buffer.is_full());
@@ -174,6 +185,1224 @@ int test_ring_buffer() {
     return 0;
 }
 
+int test_bulk_ring_buffer() {
+    std::RingBuffer<int> buffer(8);
+    const int values[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19 };
+    int out[20];
+    std::RingBuffer<int>::Span spans[2];
+
+    assert(buffer.peek(spans) == 0);
+    assert(buffer.read_n(out, 4) == 0);
+
+    buffer.write_n(values, 6);
+    assert(buffer.length() == 6);
+    assert(buffer.read_n(out, 4) == 4);
+    assert(out[0] == 0 && out[3] == 3);
+    assert(buffer.length() == 2);
+
+    buffer.write_n(values + 6, 5);
+    assert(buffer.length() == 7);
+    assert(buffer.front() == 4);
+    assert(buffer.back() == 10);
+    assert(buffer.peek(spans) == 2);
+    assert(spans[0].length == 4 && spans[0].data[0] == 4);
+    assert(spans[1].length == 3 && spans[1].data[2] == 10);
+
+    buffer.write_n(values + 11, 3);
+    assert(buffer.is_full());
+    assert(buffer.front() == 6);
+    assert(buffer.back() == 13);
+    buffer.begin();
+    int i = 6;
+    while (!buffer.end()) {
+        assert(buffer.next() == i++);
+    }
+    assert(i == 14);
+
+    buffer.consume(5);
+    assert(buffer.length() == 3);
+    assert(buffer.front() == 11);
+    assert(buffer.read_n(out, 20) == 3);
+    assert(out[0] == 11 && out[2] == 13);
+    assert(buffer.is_empty());
+
+    buffer.write_n(values, 20);
+    assert(buffer.is_full());
+    assert(buffer.front() == 12);
+    assert(buffer.back() == 19);
+    assert(buffer.peek(spans) == 2);
+    assert(spans[0].length + spans[1].length == 8);
+    assert(spans[0].data[0] == 12);
+    buffer.consume(100);
+    assert(buffer.is_empty());
+
+    return 0;
+}
+
+int test_ring_buffer_iterators() {
+    std::RingBuffer<int> buffer(8);
+    for (int i = 0; i < 13; i++) {
+        buffer.write(i);
+    }
+    assert(buffer.length() == 8);
+    assert(buffer[0] == 5);
+    assert(buffer[7] == 12);
+    assert(buffer.at(3) == 8);
+    bool thrown = false;
+    try {
+        buffer.at(8);
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    assert(buffer.cend() - buffer.cbegin() == 8);
+    assert(std::accumulate(buffer.cbegin(), buffer.cend(), 0) == 5 + 6 + 7 + 8 + 9 + 10 + 11 + 12);
+    assert(std::binary_search(buffer.cbegin(), buffer.cend(), 11));
+    assert(!std::binary_search(buffer.cbegin(), buffer.cend(), 4));
+    assert(*std::lower_bound(buffer.cbegin(), buffer.cend(), 9) == 9);
+
+    int expected = 5;
+    for (int& value : buffer.range()) {
+        assert(value == expected++);
+        value *= 2;
+    }
+    assert(expected == 13);
+    assert(buffer.front() == 10);
+    assert(buffer.back() == 24);
+
+    const std::RingBuffer<int>& view = buffer;
+    std::RingBufferRange<std::RingBuffer<int>::const_iterator> low = view.range(0, 4);
+    std::RingBufferRange<std::RingBuffer<int>::const_iterator> high = view.range(4, 8);
+    assert(std::accumulate(low.begin(), low.end(), 0) == 10 + 12 + 14 + 16);
+    assert(std::accumulate(high.begin(), high.end(), 0) == 18 + 20 + 22 + 24);
+
+    std::RingBuffer<int>::iterator it = buffer.range().begin();
+    it += 3;
+    assert(*it == 16);
+    assert(it[2] == 20);
+    assert(*(it - 1) == 14);
+    std::RingBuffer<int>::const_iterator cit = it;
+    assert(cit == buffer.cbegin() + 3);
+
+    buffer.begin();
+    expected = 10;
+    while (!buffer.end()) {
+        assert(buffer.next() == expected);
+        expected += 2;
+    }
+
+    return 0;
+}
+
+struct Counted {
+    static int live;
+    int value;
+
+    Counted() : value(0) {
+        live++;
+    }
+
+    Counted(const int value_) : value(value_) {
+        live++;
+    }
+
+    Counted(const Counted& other) : value(other.value) {
+        live++;
+    }
+
+    Counted& operator=(const Counted& other) {
+        value = other.value;
+        return (*this);
+    }
+
+    ~Counted() {
+        live--;
+    }
+};
+
+int Counted::live = 0;
+
+int test_ring_buffer_lifetime() {
+    {
+        std::RingBuffer<std::string> buffer(4);
+        buffer.emplace_back(3, 'a');
+        buffer.push(std::string("bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb"));
+        std::string c("c");
+        buffer.push(c);
+        buffer.write(std::string("d"));
+        buffer.emplace_back("e");
+        assert(buffer.is_full());
+        assert(buffer.front() == "bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb");
+        assert(buffer.back() == "e");
+        assert(buffer.pop() == "bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb");
+        assert(buffer.length() == 3);
+
+        std::string out[2];
+        assert(buffer.read_n(out, 2) == 2);
+        assert(out[0] == "c" && out[1] == "d");
+        const std::string more[] = { "f", "g", "h", "i" };
+        buffer.write_n(more, 4);
+        assert(buffer.length() == 4);
+        assert(buffer[0] == "f" && buffer[3] == "i");
+        buffer.clear();
+        assert(buffer.is_empty());
+    }
+
+    {
+        std::shared_ptr<int> shared = std::make_shared<int>(42);
+        std::RingBuffer<std::shared_ptr<int> > buffer(2);
+        buffer.push(shared);
+        assert(shared.use_count() == 2);
+        buffer.push(shared);
+        assert(shared.use_count() == 3);
+        buffer.push(std::make_shared<int>(1));
+        assert(shared.use_count() == 2);
+        std::shared_ptr<int> popped = buffer.pop();
+        assert(popped == shared);
+        assert(shared.use_count() == 2);
+        popped.reset();
+        assert(shared.use_count() == 1);
+        buffer.push(shared);
+        buffer.consume(2);
+        assert(shared.use_count() == 1);
+        buffer.push(shared);
+        buffer.clear();
+        assert(shared.use_count() == 1);
+        buffer.push(shared);
+    }
+
+    {
+        std::RingBuffer<std::shared_ptr<int> > shared(2);
+        shared.push(std::make_shared<int>(1));
+        shared.push(std::make_shared<int>(2));
+        shared.push(shared.front());
+        assert(*shared.front() == 2 && *shared.back() == 1);
+        shared.emplace_back(shared[0]);
+        assert(*shared.front() == 1 && *shared.back() == 2);
+        assert(shared.front().use_count() == 1);
+
+        std::RingBuffer<std::string> strings(2);
+        strings.push(std::string(64, 'a'));
+        strings.push(std::string(64, 'b'));
+        strings.push(std::move(strings.front()));
+        assert(strings.front() == std::string(64, 'b') && strings.back() == std::string(64, 'a'));
+        strings.emplace_back(strings[0]);
+        assert(strings.front() == std::string(64, 'a') && strings.back() == std::string(64, 'b'));
+    }
+
+    {
+        std::RingBuffer<Counted> buffer(3);
+        assert(Counted::live == 3);
+        for (int i = 0; i < 10; i++) {
+            buffer.emplace_back(i);
+        }
+        assert(Counted::live == 3);
+        assert(buffer.front().value == 7);
+        assert(buffer.pop().value == 7);
+        assert(Counted::live == 3);
+    }
+    assert(Counted::live == 0);
+
+    return 0;
+}
+
+template <typename Buffer>
+double scan_throughput(Buffer& buffer) {
+    for (size_t i = 0; i < buffer.buffer_size(); i++) {
+        buffer.write((int)i);
+    }
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    long sum = 0;
+    for (int pass = 0; pass < 4; pass++) {
+        sum += std::accumulate(buffer.cbegin(), buffer.cend(), 0L);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const long n = (long)buffer.buffer_size();
+    assert(sum == 4 * (n * (n - 1) / 2));
+    return (4 * buffer.buffer_size() * sizeof (int) / seconds / 1e9);
+}
+
+int test_ring_buffer_allocators() {
+    std::RingBuffer<int, 0, std::RingBufferHugePageAllocator> huge(SIZE);
+    base_test_ring_buffer(huge);
+    std::RingBuffer<int, 0, std::RingBufferHugePageAllocator> explicit_huge(SIZE, sizeof (int), true, false, std::RingBufferHugePageAllocator(true));
+    base_test_ring_buffer(explicit_huge);
+    std::RingBuffer<int, 0, std::RingBufferNumaAllocator> local(SIZE);
+    base_test_ring_buffer(local);
+    std::RingBuffer<int, 0, std::RingBufferNumaAllocator> bound(SIZE, sizeof (int), true, false, std::RingBufferNumaAllocator(0));
+    base_test_ring_buffer(bound);
+
+    const size_t LARGE = 1 << 23;
+    std::RingBuffer<int> malloc_scan(LARGE);
+    std::RingBuffer<int, 0, std::RingBufferHugePageAllocator> huge_scan(LARGE);
+    std::RingBuffer<int, 0, std::RingBufferNumaAllocator> numa_scan(LARGE);
+    std::cout << "scan allocator=malloc " << std::fixed << std::setprecision(2) << scan_throughput(malloc_scan) << " GB/s" << std::endl;
+    std::cout << "scan allocator=huge_page " << std::fixed << std::setprecision(2) << scan_throughput(huge_scan) << " GB/s" << std::endl;
+    std::cout << "scan allocator=numa_first_touch " << std::fixed << std::setprecision(2) << scan_throughput(numa_scan) << " GB/s" << std::endl;
+
+    return 0;
+}
+
+int test_aggregating_ring_buffer() {
+    std::AggregatingRingBuffer<double> window(4);
+    const double samples[] = { 5.0, 1.0, 4.0, 2.0, 8.0, 3.0, 3.0, 7.0, 0.5 };
+    for (size_t i = 0; i < sizeof (samples) / sizeof (samples[0]); i++) {
+        window.write(samples[i]);
+        double sum = 0.0;
+        double minimum = window.front();
+        double maximum = window.front();
+        for (const double& v : window.range()) {
+            sum += v;
+            minimum = std::min(minimum, v);
+            maximum = std::max(maximum, v);
+        }
+        const double mean = sum / window.length();
+        double variance = 0.0;
+        for (const double& v : window.range()) {
+            variance += (v - mean) * (v - mean);
+        }
+        variance /= window.length();
+        assert(std::fabs((double)window.sum() - sum) < 1e-9);
+        assert(std::fabs(window.mean() - mean) < 1e-9);
+        assert(std::fabs(window.variance() - variance) < 1e-9);
+        assert(window.min() == minimum);
+        assert(window.max() == maximum);
+    }
+    assert(window.read() == 3.0);
+    assert(window.length() == 3);
+    assert(window.min() == 0.5);
+    assert(window.max() == 7.0);
+    assert(std::fabs((double)window.sum() - 10.5) < 1e-9);
+    window.clear();
+    assert(window.sum() == 0);
+    size_t thrown = 0;
+    try {
+        window.min();
+    } catch (const std::out_of_range&) {
+        thrown++;
+    }
+    try {
+        window.max();
+    } catch (const std::out_of_range&) {
+        thrown++;
+    }
+    assert(thrown == 2);
+    window.write(2.0);
+    assert(window.min() == 2.0 && window.max() == 2.0 && window.variance() == 0.0);
+
+    std::AggregatingRingBuffer<long> counts(1000);
+    for (long i = 0; i < 100000; i++) {
+        counts.write(i % 777);
+    }
+    long sum = 0;
+    for (const long& v : counts.range()) {
+        sum += v;
+    }
+    assert(counts.sum() == sum);
+    assert(counts.min() == 0);
+    assert(counts.max() == 776);
+
+    return 0;
+}
+
+int test_quantile_ring_buffer() {
+    const double ACCURACY = 0.01;
+    const double quantiles[] = { 0.0, 0.5, 0.9, 0.99, 0.999, 1.0 };
+    std::QuantileRingBuffer<double> window(1000, ACCURACY);
+    assert(window.quantile(0.5) == 0.0);
+    uint64_t state = 12345;
+    for (size_t i = 0; i < 5000; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        // Latency-like samples spanning several decades, plus a few negatives and zeros.
+        const double sample = (i % 97 == 0) ? 0.0 : ((i % 89 == 0) ? -1.0 : 1.0) * std::exp((double)(state >> 40) / (1 << 24) * 10.0);
+        window.write(sample);
+        if (i % 499 != 0) {
+            continue;
+        }
+        std::vector<double> copy(window.cbegin(), window.cend());
+        for (size_t q = 0; q < sizeof (quantiles) / sizeof (quantiles[0]); q++) {
+            const size_t rank = (size_t)(quantiles[q] * (copy.size() - 1));
+            std::nth_element(copy.begin(), copy.begin() + rank, copy.end());
+            const double exact = copy[rank];
+            assert(std::fabs(window.quantile(quantiles[q]) - exact) <= ACCURACY * std::fabs(exact) + 1e-12);
+        }
+    }
+    assert(window.sketch().count() == window.length());
+    while (window.length() > 1) {
+        window.read();
+    }
+    const double last = window.front();
+    assert(std::fabs(window.quantile(0.0) - last) <= ACCURACY * std::fabs(last));
+    assert(window.quantile(0.0) == window.quantile(1.0));
+    window.clear();
+    assert(window.sketch().count() == 0 && window.quantile(0.99) == 0.0);
+
+    std::QuantileRingBuffer<int> low(100), high(100);
+    for (int i = 1; i <= 100; i++) {
+        low.write(i);
+        high.write(100 + i);
+    }
+    std::RingBufferQuantileSketch merged(low.sketch());
+    merged.merge(high.sketch());
+    assert(merged.count() == 200);
+    assert(std::fabs(merged.quantile(0.5) - 100.0) <= 1.0);
+    assert(std::fabs(merged.quantile(1.0) - 200.0) <= 2.0);
+    bool thrown = false;
+    try {
+        merged.merge(std::RingBufferQuantileSketch(0.05));
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    return 0;
+}
+
+template <typename T>
+void check_scan_kernels(const std::RingBuffer<T>& buffer, std::RingBuffer<T>& walker, const T threshold) {
+    const size_t BUCKETS = 16;
+    T sum = T();
+    T minimum = walker.front();
+    T maximum = walker.front();
+    size_t greater = 0;
+    size_t expected[BUCKETS] = { 0 };
+    for (walker.begin(); !walker.end(); ) {
+        const T v = walker.next();
+        sum += v;
+        minimum = std::min(minimum, v);
+        maximum = std::max(maximum, v);
+        greater += (v > threshold);
+        const double position = ((double)v + 100.0) * BUCKETS / 200.0;
+        expected[(size_t)std::max(0.0, std::min(position, (double)(BUCKETS - 1)))]++;
+    }
+    const std::RingBufferIsa isas[] = { std::RING_BUFFER_ISA_SCALAR, std::RING_BUFFER_ISA_SSE, std::RING_BUFFER_ISA_AVX2 };
+    for (size_t i = 0; i < 3; i++) {
+        assert(std::fabs((double)(std::ring_buffer_sum(buffer, isas[i]) - sum)) <= 1e-3 * std::fabs((double)sum) + 1e-3);
+        assert(std::ring_buffer_min(buffer, isas[i]) == minimum);
+        assert(std::ring_buffer_max(buffer, isas[i]) == maximum);
+        assert(std::ring_buffer_count_greater(buffer, threshold, isas[i]) == greater);
+        size_t counts[BUCKETS];
+        std::ring_buffer_histogram(buffer, -100.0, 100.0, BUCKETS, counts, isas[i]);
+        assert(std::equal(counts, counts + BUCKETS, expected));
+    }
+}
+
+template <typename T>
+void test_scan_kernels(const size_t size) {
+    std::RingBuffer<T> buffer(size);
+    assert(std::ring_buffer_sum(buffer) == T() && std::ring_buffer_count_greater(buffer, T()) == 0);
+    // Wrap the ring so the kernels see two regions of odd lengths.
+    for (size_t i = 0; i < size + size / 3; i++) {
+        buffer.write((T)((long)((i * 7919) % 251) - 125));
+    }
+    buffer.read();
+    check_scan_kernels(buffer, buffer, (T)10);
+}
+
+template <typename Kernel>
+double scan_kernel_throughput(const std::RingBuffer<double>& buffer, const std::RingBufferIsa isa, double& result) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < 8; pass++) {
+        Kernel kernel;
+        result += std::ring_buffer_scan(buffer, kernel, isa).result;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return (8 * buffer.length() * sizeof (double) / seconds / 1e9);
+}
+
+int test_scan_kernels() {
+    test_scan_kernels<double>(1001);
+    test_scan_kernels<float>(1001);
+    test_scan_kernels<int64_t>(1001);
+    test_scan_kernels<double>(3);
+
+    std::RingBuffer<double> small(4);
+    small.write(1.0);
+    size_t count = 0;
+    const double ranges[][2] = { { 0.0, 1.0 }, { 1.0, 1.0 }, { 2.0, 1.0 }, { 0.0, NAN } };
+    for (size_t i = 0; i < 4; i++) {
+        bool thrown = false;
+        try {
+            std::ring_buffer_histogram(small, ranges[i][0], ranges[i][1], (i == 0) ? 0 : 1, &count);
+        } catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    const size_t LARGE = 1 << 20;
+    std::RingBuffer<double> buffer(LARGE);
+    for (size_t i = 0; i < LARGE + LARGE / 2; i++) {
+        buffer.write((double)(i & 1023));
+    }
+    double expected = 0.0;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < 8; pass++) {
+        for (buffer.begin(); !buffer.end(); ) {
+            expected += buffer.next();
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "scan sum kernel=next() " << std::fixed << std::setprecision(2) << 8 * LARGE * sizeof (double) / seconds / 1e9 << " GB/s" << std::endl;
+    const char* names[] = { "scalar", "sse", "avx2" };
+    for (int isa = std::RING_BUFFER_ISA_SCALAR; isa <= std::ring_buffer_isa(); isa++) {
+        double result = 0.0;
+        const double rate = scan_kernel_throughput<std::RingBufferSumKernel<double> >(buffer, (std::RingBufferIsa)isa, result);
+        assert(result == expected);
+        std::cout << "scan sum kernel=" << names[isa] << " " << std::fixed << std::setprecision(2) << rate << " GB/s" << std::endl;
+    }
+
+    return 0;
+}
+
+int test_mirrored_ring_buffer() {
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    assert(page_size >= 4096);
+    std::RingBuffer<char> buffer(page_size, sizeof (char), true, true);
+    assert(buffer.is_mirrored());
+    std::RingBuffer<char>::Span spans[2];
+
+    std::vector<char> source(page_size);
+    for (size_t i = 0; i < page_size; i++) {
+        source[i] = (char)(i % 128);
+    }
+    std::vector<char> destination(page_size);
+    buffer.write_n(&source[0], page_size - 10);
+    assert(buffer.read_n(&destination[0], page_size - 20) == page_size - 20);
+    buffer.write_n(&source[0], 100);
+    assert(buffer.length() == 110);
+    assert(buffer.peek(spans) == 1);
+    assert(spans[0].length == 110);
+    for (size_t i = 0; i < 10; i++) {
+        assert(spans[0].data[i] == source[page_size - 20 + i]);
+    }
+    for (size_t i = 0; i < 100; i++) {
+        assert(spans[0].data[10 + i] == source[i]);
+    }
+    buffer.consume(110);
+    assert(buffer.is_empty());
+
+    std::RingBuffer<char> unaligned(page_size + 1, sizeof (char), true, true);
+    assert(!unaligned.is_mirrored());
+    unaligned.write_n(&source[0], 10);
+    assert(unaligned.read_n(&destination[0], 10) == 10);
+    assert(destination[9] == source[9]);
+
+    return 0;
+}
+
+int test_fixed_ring_buffer() {
+    std::RingBuffer<int, SIZE> buffer;
+    base_test_ring_buffer(buffer);
+    base_test_ring_buffer(buffer);
+    base_test_ring_buffer(buffer);
+
+    static_assert(std::is_trivially_copyable<std::RingBuffer<int, SIZE> >::value, "fixed ring must be trivially copyable");
+    static_assert(std::RingBuffer<int, 3>::buffer_size() == 3, "capacity must be a constant expression");
+
+    std::RingBuffer<int, 3> rings[2];
+    for (int i = 0; i < 10; i++) {
+        rings[0].write(i);
+    }
+    memcpy((void*)&rings[1], (void*)&rings[0], sizeof (rings[0]));
+    assert(rings[1].length() == 3);
+    assert(rings[1].read() == 7);
+    assert(rings[1].read() == 8);
+    assert(rings[1].read() == 9);
+    assert(rings[1].is_empty());
+    assert(rings[0].front() == 7);
+
+    return 0;
+}
+
+int test_power_of_two_ring_buffer() {
+    std::PowerOfTwoRingBuffer<int> buffer(SIZE);
+    base_test_ring_buffer(buffer);
+    base_test_ring_buffer(buffer);
+    base_test_ring_buffer(buffer);
+
+    std::PowerOfTwoRingBuffer<int> wrapped(8);
+    assert(wrapped.buffer_size() == 8);
+    for (int i = 0; i < 1000; i++) {
+        wrapped.write(i);
+        assert(wrapped.back() == i);
+        assert(wrapped.length() == (size_t)((i < 8) ? i + 1 : 8));
+        assert(wrapped.front() == ((i < 8) ? 0 : i - 7));
+    }
+    assert(wrapped.read() == 992);
+    assert(wrapped.length() == 7);
+
+    const size_t invalid[] = { 0, 5, 12 };
+    for (size_t i = 0; i < 3; i++) {
+        bool thrown = false;
+        try {
+            std::PowerOfTwoRingBuffer<int> rejected(invalid[i]);
+        } catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    return 0;
+}
+
+int test_record_ring_buffer() {
+    std::RecordRingBuffer buffer(64);
+    assert(buffer.buffer_size() == 64);
+    assert(buffer.is_empty());
+    assert(buffer.begin() == buffer.end());
+
+    assert(buffer.write("hello", 5));
+    assert(buffer.write("", 0));
+    assert(buffer.write("ring buffer", 11));
+    assert(buffer.length() == 3);
+    assert(buffer.bytes() == 12 + 4 + 16);
+
+    const char* expected[] = { "hello", "", "ring buffer" };
+    size_t i = 0;
+    for (std::RecordRingBuffer::const_iterator it = buffer.begin(); it != buffer.end(); ++it) {
+        const std::RecordRingBuffer::Record record = *it;
+        assert(record.length == strlen(expected[i]));
+        assert(memcmp(record.data, expected[i], record.length) == 0);
+        i++;
+    }
+    assert(i == 3);
+
+    assert(buffer.write("0123456789abcdefghijklmnopqr", 28));
+    assert(buffer.length() == 4);
+    assert(buffer.bytes() == 64);
+    assert(buffer.write("abc", 3));
+    assert(buffer.length() == 4);
+    assert(buffer.front().length == 0);
+    assert(buffer.write("0123456789abcdefghij", 20));
+    assert(buffer.write("0123456789abcdefghijklmn", 24));
+    assert(buffer.length() == 3);
+    assert(memcmp(buffer.front().data, "abc", 3) == 0);
+
+    // 4 bytes are left before the end of the arena, so the next record is
+    // preceded by a padding marker and starts at offset 0.
+    assert(buffer.write("wrap", 4));
+    assert(buffer.length() == 3);
+    const size_t lengths[] = { 20, 24, 4 };
+    i = 0;
+    for (std::RecordRingBuffer::const_iterator it = buffer.begin(); it != buffer.end(); ++it) {
+        assert((*it).length == lengths[i++]);
+    }
+    assert(i == 3);
+    std::RecordRingBuffer::Record record = buffer.read();
+    assert(memcmp(record.data, "0123456789abcdefghij", 20) == 0);
+    buffer.read();
+    record = buffer.read();
+    assert(memcmp(record.data, "wrap", 4) == 0);
+    assert(buffer.is_empty());
+    assert(buffer.bytes() == 0);
+
+    assert(!buffer.write("this record is far too long to ever fit into the arena at all", 61));
+
+    for (int n = 0; n < 1000; n++) {
+        char payload[32];
+        const size_t length = (size_t)(n % 27);
+        memset(payload, 'a' + (n % 26), length);
+        assert(buffer.write(payload, length));
+        const std::RecordRingBuffer::Record last = buffer.front();
+        assert(buffer.bytes() <= buffer.buffer_size());
+        assert(last.length <= 26);
+    }
+    i = 0;
+    for (std::RecordRingBuffer::const_iterator it = buffer.begin(); it != buffer.end(); ++it) {
+        i++;
+    }
+    assert(i == buffer.length());
+    buffer.clear();
+    assert(buffer.is_empty());
+
+    // A record that only fits from the arena base must not be lost when the
+    // ring is, or becomes, empty with its end cursor mid-arena.
+    std::RecordRingBuffer small(16);
+    assert(small.write("abcd", 4));
+    small.read();
+    assert(small.write("abcdefgh", 8));
+    assert(small.length() == 1 && small.bytes() == 12);
+    assert(memcmp(small.read().data, "abcdefgh", 8) == 0);
+    small.clear();
+    assert(small.write("", 0) && small.write("", 0));
+    small.read();
+    assert(small.write("abcdefgh", 8));
+    assert(small.length() == 1 && small.bytes() == 12);
+    assert(memcmp(small.front().data, "abcdefgh", 8) == 0);
+
+    return 0;
+}
+
+int test_spsc_ring_buffer() {
+    const int COUNT = 1000000;
+    std::SpscRingBuffer<int> buffer(1000);
+    assert(buffer.buffer_size() == 1024);
+    assert(buffer.is_empty());
+    assert(!buffer.is_full());
+
+    int value = 0;
+    assert(!buffer.read(value));
+    for (int i = 0; i < 1024; i++) {
+        assert(buffer.write(i));
+    }
+    assert(buffer.is_full());
+    assert(!buffer.write(1024));
+    for (int i = 0; i < 1024; i++) {
+        assert(buffer.read(value));
+        assert(value == i);
+    }
+    assert(buffer.is_empty());
+
+    std::thread producer([&buffer, COUNT]() {
+        for (int i = 0; i < COUNT; i++) {
+            while (!buffer.write(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    std::thread consumer([&buffer, COUNT]() {
+        int v = 0;
+        for (int i = 0; i < COUNT; i++) {
+            while (!buffer.read(v)) {
+                std::this_thread::yield();
+            }
+            assert(v == i);
+        }
+    });
+    producer.join();
+    consumer.join();
+    assert(buffer.is_empty());
+
+    return 0;
+}
+
+struct Frame {
+    uint32_t sequence;
+    char payload[4092];
+};
+
+int test_claim_publish_ring_buffer() {
+    std::RingBuffer<int> buffer(4);
+    std::RingBuffer<int>::Span spans[2];
+    buffer.write(1);
+    buffer.write(2);
+    buffer.write(3);
+    assert(buffer.claim(spans, 3) == 2);
+    assert(spans[0].length == 1 && spans[1].length == 2);
+    spans[0].data[0] = 4;
+    spans[1].data[0] = 5;
+    spans[1].data[1] = 6;
+    assert(buffer.length() == 3);
+    assert(buffer.back() == 3);
+    buffer.publish(3);
+    assert(buffer.is_full());
+    assert(buffer.front() == 3);
+    assert(buffer.back() == 6);
+    assert(buffer.claim(spans, 10) == 2);
+    assert(spans[0].length + spans[1].length == 4);
+
+    const uint32_t COUNT = 20000;
+    std::SpscRingBuffer<Frame, std::RingBufferYieldWait> frames(64);
+    std::thread producer([&frames, COUNT]() {
+        uint32_t sequence = 0;
+        std::SpscRingBuffer<Frame, std::RingBufferYieldWait>::Span claimed[2];
+        while (sequence < COUNT) {
+            const size_t count = frames.claim(claimed, std::min<size_t>(16, COUNT - sequence));
+            size_t filled = 0;
+            for (size_t s = 0; s < count; s++) {
+                for (size_t i = 0; i < claimed[s].length; i++) {
+                    claimed[s].data[i].sequence = sequence;
+                    memset(claimed[s].data[i].payload, (int)(sequence & 0x7f), sizeof (claimed[s].data[i].payload));
+                    sequence++;
+                    filled++;
+                }
+            }
+            if (filled) {
+                frames.publish(filled);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t expected = 0;
+    std::SpscRingBuffer<Frame, std::RingBufferYieldWait>::Span readable[2];
+    while (expected < COUNT) {
+        const size_t count = frames.peek(readable);
+        size_t seen = 0;
+        for (size_t s = 0; s < count; s++) {
+            for (size_t i = 0; i < readable[s].length; i++) {
+                assert(readable[s].data[i].sequence == expected);
+                assert(readable[s].data[i].payload[4091] == (char)(expected & 0x7f));
+                expected++;
+                seen++;
+            }
+        }
+        if (seen) {
+            frames.release(seen);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    assert(frames.is_empty());
+
+    return 0;
+}
+
+int test_mpmc_ring_buffer() {
+    std::MpmcRingBuffer<long> buffer(6);
+    assert(buffer.buffer_size() == 8);
+    assert(buffer.is_empty());
+    long value = 0;
+    assert(!buffer.try_read(value));
+    for (long i = 0; i < 8; i++) {
+        assert(buffer.try_write(i));
+    }
+    assert(buffer.is_full());
+    assert(!buffer.try_write(8));
+    for (long i = 0; i < 8; i++) {
+        assert(buffer.try_read(value));
+        assert(value == i);
+    }
+    assert(buffer.is_empty());
+    return 0;
+}
+
+template <typename Buffer>
+int run_blocking_ring_buffer(Buffer& buffer, const int producers, const int consumers) {
+    const long COUNT = 100000;
+    std::atomic<long> sum(0);
+    std::vector<std::thread> workers;
+    for (int p = 0; p < producers; p++) {
+        workers.push_back(std::thread([&buffer, producers, COUNT]() {
+            for (long i = 1; i <= COUNT / producers; i++) {
+                assert(buffer.write_wait(i));
+            }
+        }));
+    }
+    for (int c = 0; c < consumers; c++) {
+        workers.push_back(std::thread([&buffer, &sum, producers, consumers, COUNT]() {
+            long v = 0;
+            long local = 0;
+            for (long i = 0; i < (COUNT / producers) * producers / consumers; i++) {
+                assert(buffer.read_wait(v));
+                local += v;
+            }
+            sum += local;
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+    const long per_producer = COUNT / producers;
+    assert(sum.load() == producers * per_producer * (per_producer + 1) / 2);
+    assert(buffer.is_empty());
+    return 0;
+}
+
+int test_blocking_ring_buffer() {
+    std::SpscRingBuffer<long> spin(2);
+    long value = 0;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    assert(!spin.read_wait(value, std::chrono::milliseconds(2)));
+    assert(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(2));
+    assert(spin.write_wait(1, std::chrono::milliseconds(2)));
+    assert(spin.write_wait(2, std::chrono::milliseconds(2)));
+    assert(!spin.write_wait(3, std::chrono::milliseconds(2)));
+    assert(spin.read_wait(value, std::chrono::milliseconds(2)) && value == 1);
+
+    std::SpscRingBuffer<long, std::RingBufferFutexWait> futex(2);
+    assert(!futex.read_wait(value, std::chrono::milliseconds(2)));
+    std::thread late([&futex]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        futex.write(42);
+    });
+    assert(futex.read_wait(value) && value == 42);
+    late.join();
+
+    std::SpscRingBuffer<long, std::RingBufferYieldWait> spsc_yield(64);
+    run_blocking_ring_buffer(spsc_yield, 1, 1);
+    std::SpscRingBuffer<long, std::RingBufferFutexWait> spsc_futex(64);
+    run_blocking_ring_buffer(spsc_futex, 1, 1);
+    std::MpmcRingBuffer<long, std::RingBufferFutexWait> mpmc_futex(64);
+    run_blocking_ring_buffer(mpmc_futex, 2, 2);
+
+    std::MpmcRingBuffer<long> overwrite(4);
+    for (long i = 0; i < 6; i++) {
+        overwrite.write_overwrite(i);
+    }
+    for (long i = 2; i < 6; i++) {
+        assert(overwrite.try_read(value) && value == i);
+    }
+    assert(!overwrite.read_wait(value, std::chrono::microseconds(100)));
+
+    return 0;
+}
+
+int test_mpmc_ring_buffer_scaling() {
+    const long COUNT = 1 << 20;
+    unsigned int max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    for (unsigned int threads = 1; threads <= max_threads; threads <<= 1) {
+        std::MpmcRingBuffer<long> buffer(1024);
+        std::vector<long> sums(threads, 0);
+        std::vector<std::thread> workers;
+        const long per_thread = COUNT / threads;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned int t = 0; t < threads; t++) {
+            workers.push_back(std::thread([&buffer, per_thread]() {
+                for (long i = 1; i <= per_thread; i++) {
+                    while (!buffer.try_write(i)) {
+                        std::this_thread::yield();
+                    }
+                }
+            }));
+            workers.push_back(std::thread([&buffer, &sums, per_thread, t]() {
+                long v = 0;
+                for (long i = 0; i < per_thread; i++) {
+                    while (!buffer.try_read(v)) {
+                        std::this_thread::yield();
+                    }
+                    sums[t] += v;
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        long total = 0;
+        for (unsigned int t = 0; t < threads; t++) {
+            total += sums[t];
+        }
+        assert(total == (long)threads * per_thread * (per_thread + 1) / 2);
+        assert(buffer.is_empty());
+        std::cout << "mpmc producers=" << threads << " consumers=" << threads << " "
+                  << std::fixed << std::setprecision(1) << (threads * per_thread) / seconds / 1e6 << " Mops/s" << std::endl;
+    }
+    return 0;
+}
+
+int test_broadcast_ring_buffer() {
+    std::BroadcastRingBuffer<int> buffer(4, 2);
+    assert(buffer.buffer_size() == 4);
+    int value = 0;
+    assert(!buffer.try_read(0, value));
+    for (int i = 0; i < 4; i++) {
+        assert(buffer.try_write(i));
+    }
+    assert(!buffer.try_write(4));
+    assert(buffer.available(0) == 4);
+    assert(buffer.try_read(0, value) && value == 0);
+    assert(!buffer.try_write(4));
+    int sum = 0;
+    assert(buffer.read(1, [&sum](const int& v) { sum += v; }, 2) == 2);
+    assert(sum == 1);
+    assert(buffer.try_write(4));
+    assert(!buffer.try_write(5));
+    assert(buffer.read(0, [&sum](const int& v) { sum += v; }) == 4);
+    assert(buffer.read(1, [&sum](const int& v) { sum += v; }) == 3);
+    assert(sum == 1 + 1 + 2 + 3 + 4 + 2 + 3 + 4);
+    assert(buffer.available(0) == 0 && buffer.available(1) == 0);
+
+    const long COUNT = 200000;
+    std::BroadcastRingBuffer<long> pipeline(256, 3);
+    pipeline.add_dependency(2, 0);
+    std::vector<long> totals(3, 0);
+    std::vector<std::thread> workers;
+    for (size_t c = 0; c < 3; c++) {
+        workers.push_back(std::thread([&pipeline, &totals, c, COUNT]() {
+            long seen = 0;
+            long expected = 1;
+            while (seen < COUNT) {
+                const size_t n = pipeline.read(c, [&](const long& v) {
+                    assert(v == expected++);
+                    if (c == 2) {
+                        assert(pipeline.cursor(0) >= (uint64_t)v);
+                    }
+                    totals[c] += v;
+                });
+                if (n == 0) {
+                    std::this_thread::yield();
+                }
+                seen += (long)n;
+            }
+        }));
+    }
+    for (long i = 1; i <= COUNT; i++) {
+        pipeline.write(i);
+    }
+    for (size_t c = 0; c < workers.size(); c++) {
+        workers[c].join();
+    }
+    for (size_t c = 0; c < 3; c++) {
+        assert(totals[c] == COUNT * (COUNT + 1) / 2);
+    }
+
+    return 0;
+}
+
+struct Sample {
+    uint64_t value;
+    uint64_t check;
+};
+
+int test_seqlock_ring_buffer() {
+    std::SeqlockRingBuffer<Sample> buffer(4);
+    Sample sample = { 0, 0 };
+    uint64_t cursor = 0;
+    assert(!buffer.try_read(cursor, sample));
+    for (uint64_t i = 0; i < 6; i++) {
+        const Sample s = { i, ~i };
+        buffer.write(s);
+    }
+    assert(buffer.length() == 4);
+    assert(!buffer.read(0, sample));
+    assert(buffer.read(5, sample) && sample.value == 5);
+    assert(buffer.try_read(cursor, sample) && sample.value == 2);
+    assert(cursor == 3);
+    Sample latest[8];
+    assert(buffer.read_latest(latest, 8) == 4);
+    assert(latest[0].value == 2 && latest[3].value == 5);
+    assert(buffer.read_latest(latest, 2) == 2);
+    assert(latest[0].value == 4 && latest[1].value == 5);
+
+    const uint64_t COUNT = 500000;
+    std::SeqlockRingBuffer<Sample> telemetry(64);
+    std::atomic<bool> done(false);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r++) {
+        readers.push_back(std::thread([&telemetry, &done]() {
+            uint64_t position = 0;
+            uint64_t last = 0;
+            bool first = true;
+            Sample s;
+            while (!done.load()) {
+                while (telemetry.try_read(position, s)) {
+                    assert(s.check == ~s.value);
+                    assert(first || (s.value > last));
+                    last = s.value;
+                    first = false;
+                }
+                Sample window[64];
+                const size_t n = telemetry.read_latest(window, 64);
+                for (size_t i = 0; i < n; i++) {
+                    assert(window[i].check == ~window[i].value);
+                }
+                std::this_thread::yield();
+            }
+        }));
+    }
+    for (uint64_t i = 0; i < COUNT; i++) {
+        const Sample s = { i, ~i };
+        telemetry.write(s);
+    }
+    done.store(true);
+    for (size_t r = 0; r < readers.size(); r++) {
+        readers[r].join();
+    }
+    assert(telemetry.cursor() == COUNT);
+
+    return 0;
+}
+
+int test_sharded_ring_buffer() {
+    const int THREADS = 8;
+    const long PER_THREAD = 10000;
+    std::ShardedRingBuffer<long> buffer(1 << 14);
+    std::vector<std::thread> producers;
+    for (int t = 0; t < THREADS; t++) {
+        producers.push_back(std::thread([&buffer, t, PER_THREAD, THREADS]() {
+            for (long i = 0; i < PER_THREAD; i++) {
+                const long stamp = i * THREADS + t;
+                assert(buffer.write(stamp, (uint64_t)stamp));
+            }
+        }));
+    }
+    for (size_t t = 0; t < producers.size(); t++) {
+        producers[t].join();
+    }
+    assert(buffer.shard_count() == THREADS);
+
+    long expected = 0;
+    assert(buffer.drain_ordered([&expected](const long& v) { assert(v == expected++); }, 1000) == 1000);
+    assert(buffer.drain_ordered([&expected](const long& v) { assert(v == expected++); }) == THREADS * PER_THREAD - 1000);
+    assert(expected == THREADS * PER_THREAD);
+    assert(buffer.is_empty());
+
+    std::ShardedRingBuffer<int> small(4, 2);
+    std::atomic<int> rejected(0);
+    for (int t = 0; t < 3; t++) {
+        std::thread([&small, &rejected]() {
+            for (int i = 0; i < 6; i++) {
+                if (!small.write(i)) {
+                    rejected++;
+                }
+            }
+        }).join();
+    }
+    assert(small.shard_count() == 2);
+    assert(rejected.load() == 2 + 2 + 6);
+    long total = 0;
+    int previous = -1;
+    assert(small.drain([&total](const int& v) { total += v; }, 3) == 3);
+    assert(small.drain([&total, &previous](const int& v) { total += v; previous = v; }) == 5);
+    assert(total == 2 * (0 + 1 + 2 + 3));
+    assert(previous == 3);
+    assert(small.is_empty());
+
+    return 0;
+}
+
+int test_persistent_ring_buffer() {
+    char path[] = "/tmp/ring_buffer_test_XXXXXX";
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    {
+        std::PersistentRingBuffer<Sample> buffer(path, 8);
+        assert(buffer.is_open());
+        assert(!buffer.is_recovered());
+        assert(buffer.is_empty());
+        for (uint64_t i = 0; i < 10; i++) {
+            const Sample s = { i, ~i };
+            buffer.write(s);
+        }
+        assert(buffer.read().value == 2);
+        assert(buffer.flush());
+    }
+    {
+        std::PersistentRingBuffer<Sample> buffer(path, 8);
+        assert(buffer.is_open());
+        assert(buffer.is_recovered());
+        assert(buffer.length() == 7);
+        assert(buffer.front().value == 3);
+        assert(buffer.back().value == 9);
+        assert(buffer[2].check == ~(uint64_t)5);
+    }
+    {
+        std::PersistentRingBuffer<Sample> other_size(path, 16);
+        assert(!other_size.is_open());
+        std::PersistentRingBuffer<int> other_type(path, 8);
+        assert(!other_type.is_open());
+    }
+
+    const pid_t child = fork();
+    assert(child >= 0);
+    if (child == 0) {
+        std::PersistentRingBuffer<Sample> buffer(path, 8);
+        for (uint64_t i = 100; ; i++) {
+            const Sample s = { i, ~i };
+            buffer.write(s);
+            if (i == 100000) {
+                raise(SIGKILL);
+            }
+        }
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    assert(WIFSIGNALED(status));
+    {
+        std::PersistentRingBuffer<Sample> buffer(path, 8, 4);
+        assert(buffer.is_recovered());
+        assert(buffer.is_full());
+        assert(buffer.back().value == 100000);
+        for (size_t i = 0; i < buffer.length(); i++) {
+            assert(buffer[i].check == ~buffer[i].value);
+            assert(buffer[i].value == 100000 - 7 + i);
+        }
+        buffer.clear();
+    }
+    {
+        std::PersistentRingBuffer<Sample> buffer(path, 8);
+        assert(buffer.is_recovered());
+        assert(buffer.is_empty());
+    }
+
+    const char text[] = "not a ring buffer\n";
+    FILE* file = fopen(path, "w");
+    assert(file && (fwrite(text, 1, sizeof (text) - 1, file) == sizeof (text) - 1));
+    fclose(file);
+    {
+        std::PersistentRingBuffer<Sample> buffer(path, 8);
+        assert(!buffer.is_open());
+    }
+    char contents[sizeof (text)] = { 0 };
+    file = fopen(path, "r");
+    assert(file && (fread(contents, 1, sizeof (contents), file) == sizeof (text) - 1));
+    fclose(file);
+    assert(strcmp(contents, text) == 0);
+
+    unlink(path);
+    return 0;
+}
+
+int test_shared_ring_buffer() {
+    const char* name = "/ring_buffer_test_shared";
+    std::SharedRingBuffer<Sample>::remove(name);
+    std::SharedRingBuffer<Sample> missing(name);
+    assert(!missing.is_open());
+
+    const uint64_t COUNT = 100000;
+    std::SharedRingBuffer<Sample> buffer(name, 100);
+    assert(buffer.is_open());
+    assert(buffer.buffer_size() == 128);
+    std::SharedRingBuffer<Sample> duplicate(name, 100);
+    assert(!duplicate.is_open());
+    std::SharedRingBuffer<int> wrong_type(name);
+    assert(!wrong_type.is_open());
+
+    const pid_t child = fork();
+    assert(child >= 0);
+    if (child == 0) {
+        std::SharedRingBuffer<Sample> producer(name);
+        if (!producer.is_open()) {
+            _exit(1);
+        }
+        uint64_t i = 0;
+        while (i < COUNT) {
+            std::SharedRingBuffer<Sample>::Span spans[2];
+            const size_t count = producer.claim(spans, 32);
+            size_t filled = 0;
+            for (size_t s = 0; (s < count) && (i < COUNT); s++) {
+                for (size_t k = 0; (k < spans[s].length) && (i < COUNT); k++, i++, filled++) {
+                    spans[s].data[k].value = i;
+                    spans[s].data[k].check = ~i;
+                }
+            }
+            if (filled) {
+                producer.publish(filled);
+            } else {
+                sched_yield();
+            }
+        }
+        _exit(0);
+    }
+
+    uint64_t expected = 0;
+    Sample sample;
+    while (expected < COUNT) {
+        if (buffer.read(sample)) {
+            assert(sample.value == expected);
+            assert(sample.check == ~expected);
+            expected++;
+        } else {
+            sched_yield();
+        }
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    assert(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+    assert(buffer.is_empty());
+
+    return 0;
+}
+
 int main() {
-    return test_ring_buffer();
+    return test_ring_buffer() || test_bulk_ring_buffer() || test_ring_buffer_iterators() || test_ring_buffer_lifetime() || test_ring_buffer_allocators() || test_aggregating_ring_buffer() || test_quantile_ring_buffer() || test_scan_kernels() || test_mirrored_ring_buffer() || test_fixed_ring_buffer() || test_power_of_two_ring_buffer() || test_record_ring_buffer() || test_spsc_ring_buffer() || test_claim_publish_ring_buffer() || test_mpmc_ring_buffer() || test_mpmc_ring_buffer_scaling() || test_blocking_ring_buffer() || test_broadcast_ring_buffer() || test_seqlock_ring_buffer() || test_sharded_ring_buffer() || test_persistent_ring_buffer() || test_shared_ring_buffer();
 }
\ No newline at end of file